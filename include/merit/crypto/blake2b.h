@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_MINER_BLAKE2B_H
+#define MERIT_MINER_BLAKE2B_H
+
+#include <cstddef>
+
+namespace merit
+{
+    namespace crypto
+    {
+        // BLAKE2b implementations picked at runtime. Ref is the reference
+        // C code, AVX2 compresses single messages in four 64 bit lanes and
+        // batches four messages at a time, one per lane.
+        enum class Blake2bImpl { Auto, Ref, AVX2 };
+
+        const char* to_string(Blake2bImpl);
+
+        // Forces an implementation, falling back to Ref where the cpu lacks
+        // it, and Auto restores the default. Call it before any hashing
+        // starts.
+        void select_blake2b(Blake2bImpl requested);
+
+        // The implementation in use.
+        Blake2bImpl blake2b_impl();
+
+        // Unkeyed BLAKE2b of inlen bytes into outlen <= 64 bytes.
+        void blake2b(unsigned char* out, size_t outlen, const unsigned char* in, size_t inlen);
+
+        // The same for n messages of inlen bytes. Digest i goes to
+        // out + i * outlen.
+        void blake2b_batch(
+                unsigned char* out,
+                size_t outlen,
+                const unsigned char* const* in,
+                size_t inlen,
+                size_t n);
+    }
+}
+#endif
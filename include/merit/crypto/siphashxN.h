@@ -1,9 +1,12 @@
 #ifndef INCLUDE_SIPHASHXN_H
 #define INCLUDE_SIPHASHXN_H
 
-#ifdef __AVX2__
+#if defined(__x86_64__) || defined(__i386__)
 
-#include <immintrin.h> // for _mm256_* intrinsics
+// The lane macros are plain text and only need the intrinsics of the
+// function they expand in, so on x86 they are defined regardless of the
+// compile flags. Callers pick the width with NSIPHASH.
+#include <immintrin.h> // for _mm256_* and _mm512_* intrinsics
 
 #define ADD(a, b) _mm256_add_epi64(a, b)
 #define XOR(a, b) _mm256_xor_si256(a, b)
@@ -47,15 +50,56 @@
         v6 = ROT32(v6);   \
     } while (0)
 
-#ifndef NSIPHASH
-#define NSIPHASH 8
-#endif
+// 16 way siphash over two sets of 8 lanes. AVX-512 has native 64 bit
+// rotates so no shuffles are needed.
+#define ADD16(a, b) _mm512_add_epi64(a, b)
+#define XOR16(a, b) _mm512_xor_si512(a, b)
+#define ROTX16(x, b) _mm512_rol_epi64(x, b)
+
+#define SIPROUNDX16           \
+    do {                      \
+        v0 = ADD16(v0, v1);   \
+        v4 = ADD16(v4, v5);   \
+        v2 = ADD16(v2, v3);   \
+        v6 = ADD16(v6, v7);   \
+        v1 = ROTX16(v1, 13);  \
+        v5 = ROTX16(v5, 13);  \
+        v3 = ROTX16(v3, 16);  \
+        v7 = ROTX16(v7, 16);  \
+        v1 = XOR16(v1, v0);   \
+        v5 = XOR16(v5, v4);   \
+        v3 = XOR16(v3, v2);   \
+        v7 = XOR16(v7, v6);   \
+        v0 = ROTX16(v0, 32);  \
+        v4 = ROTX16(v4, 32);  \
+        v2 = ADD16(v2, v1);   \
+        v6 = ADD16(v6, v5);   \
+        v0 = ADD16(v0, v3);   \
+        v4 = ADD16(v4, v7);   \
+        v1 = ROTX16(v1, 17);  \
+        v5 = ROTX16(v5, 17);  \
+        v3 = ROTX16(v3, 21);  \
+        v7 = ROTX16(v7, 21);  \
+        v1 = XOR16(v1, v2);   \
+        v5 = XOR16(v5, v6);   \
+        v3 = XOR16(v3, v0);   \
+        v7 = XOR16(v7, v4);   \
+        v2 = ROTX16(v2, 32);  \
+        v6 = ROTX16(v6, 32);  \
+    } while (0)
 
 #endif
 
+// builds without runtime dispatch hash as many lanes as the compile flags
+// allow
 #ifndef NSIPHASH
+#if defined(__AVX512F__)
+#define NSIPHASH 16
+#elif defined(__AVX2__)
+#define NSIPHASH 8
+#else
 #define NSIPHASH 1
 #endif
-
+#endif
 
 #endif // ifdef INCLUDE_SIPHASHXN_H
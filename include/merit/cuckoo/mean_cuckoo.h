@@ -32,8 +32,17 @@
 #define MERIT_CUCKOO_MEAN_CUCKOO_H
 
 #include "merit/ctpl/ctpl.h"
+#include "merit/util/barrier.hpp"
+#include "merit/util/cancel.hpp"
+#include "merit/util/cpu.hpp"
+#include "merit/util/memory.hpp"
+#include "merit/util/topology.hpp"
 
+#include <chrono>
+#include <future>
+#include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 namespace merit
@@ -43,7 +52,75 @@ namespace merit
         using Cycle = std::set<uint32_t>;
         using Cycles = std::vector<Cycle>;
 
-        // Find proofsize-length cuckoo cycle in random graph
+        // Mean is the bucket sorting solver. Lean trims with an edge bitmap
+        // and node degree bits, slower but with a fraction of the memory.
+        // Auto picks lean when mean would not fit the memory budget.
+        enum class Engine { Auto, Mean, Lean };
+
+        const char* to_string(Engine);
+
+        struct SolverOptions
+        {
+            // page size requested for the bucket matrix and thread buckets
+            util::PageBacking pages = util::PageBacking::Normal;
+
+            // NUMA node the solver memory prefers and the cpus its
+            // trimming threads are pinned to. unset when negative/empty.
+            int numa_node = -1;
+            util::CpuSet cpus;
+
+            // simd level of the siphash kernels. levels the cpu lacks
+            // fall back to the best one it has.
+            util::Isa isa = util::Isa::Auto;
+
+            // how long trimming threads spin at a round barrier before
+            // sleeping. zero sleeps right away.
+            std::chrono::microseconds barrier_spin = util::SpinBarrier::DEFAULT_SPIN;
+
+            Engine engine = Engine::Auto;
+
+            // bytes the mean solver may use before Auto switches to lean.
+            // zero means no limit.
+            std::uint64_t memory_budget = 0;
+
+            // split the cycle search of the trimmed graph over the trimming
+            // threads. finds the same cycles as the serial search, but the
+            // extra barriers make it slower on small graphs.
+            bool parallel_cycles = false;
+
+            // stop trimming once a pair of rounds removes less than this
+            // share of the surviving edges, instead of always running the
+            // fixed round count. zero keeps the fixed count.
+            double trim_stop_rate = 0;
+
+            // time every stage of the mean solver and count the edges each
+            // trimming round leaves, see GraphTelemetry
+            bool telemetry = false;
+
+            // stage the bucket scatters of the first rounds in cache line
+            // buffers and write whole lines with streaming stores, keeping
+            // the buckets out of the cache until the next round reads them
+            bool streaming_stores = false;
+        };
+
+        // Where the last graph's time went. Round 0 is genUnodes, round 1
+        // genVnodes and the rest are trimming rounds in the order they ran.
+        // Only the mean solver records it, and pipelined graphs only get
+        // their rounds since their cycles are searched on another thread.
+        struct GraphTelemetry
+        {
+            std::vector<std::chrono::nanoseconds> round_time;
+
+            // edges surviving each round
+            std::vector<std::uint64_t> round_edges;
+
+            // the cycle search and the nonce recovery of its cycles
+            std::chrono::nanoseconds find_time{0};
+            std::chrono::nanoseconds match_time{0};
+        };
+
+        // Find proofsize-length cuckoo cycle in random graph. Gives up
+        // between trimming rounds once cancel is cancelled.
         bool FindCycles(
                 const char* hex_header_hash,
                 uint32_t hex_header_hash_len,
@@ -51,7 +128,131 @@ namespace merit
                 uint8_t proofSize,
                 Cycles& cycles,
                 size_t threads_number,
-                ctpl::thread_pool&);
+                ctpl::thread_pool&,
+                const SolverOptions& options = SolverOptions{},
+                const util::CancelToken& cancel = util::CancelToken{});
+
+        // Solves one graph per header, several at once with one thread
+        // each. cycles gets an entry per header. Returns true when any
+        // graph has a cycle.
+        bool FindCycles(
+                const std::vector<std::string>& hex_header_hashes,
+                uint8_t edgeBits,
+                uint8_t proofSize,
+                std::vector<Cycles>& cycles,
+                size_t threads_number,
+                ctpl::thread_pool&,
+                const SolverOptions& options = SolverOptions{});
+
+        // Memory each engine needs for a graph of edgeBits, the mean one
+        // with or without the union find of the parallel cycle search.
+        std::uint64_t mean_bytes(uint8_t edgeBits, size_t threads_number, bool parallel_cycles = false);
+        std::uint64_t lean_bytes(uint8_t edgeBits);
+
+        // Engine Auto resolves to for the graph size.
+        Engine select_engine(const SolverOptions&, uint8_t edgeBits, size_t threads_number);
+
+        // Memory a Solver takes for graphs of edgeBits with the engine it
+        // would pick, solving each graph over all threads or, batched, one
+        // graph per thread.
+        std::uint64_t solver_bytes(
+                const SolverOptions&,
+                uint8_t edgeBits,
+                size_t threads_number,
+                bool batched = false);
+
+        // Kernel level a solver will use for the requested one.
+        util::Isa select_isa(util::Isa requested);
+
+        class solver_base;
+
+        // Long lived solver which keeps its bucket matrix, thread buffers
+        // and barrier between attempts. The memory is only rebuilt when
+        // the edge bits or proof size change.
+        class Solver
+        {
+            public:
+                Solver(
+                        size_t threads_number,
+                        ctpl::thread_pool&,
+                        const SolverOptions& options = SolverOptions{});
+                ~Solver();
+
+                // Gives up on the graph, finding no cycles, once cancel
+                // is cancelled. It is checked between trimming rounds and
+                // during the cycle search, see aborted().
+                bool find_cycles(
+                        const char* hex_header_hash,
+                        uint32_t hex_header_hash_len,
+                        uint8_t edgeBits,
+                        uint8_t proofSize,
+                        Cycles& cycles,
+                        const util::CancelToken& cancel = util::CancelToken{});
+
+                // Pipelined variant. Returns once the graph is trimmed and
+                // its surviving edges are copied out; cycle finding runs on
+                // one pool thread while the caller starts the next graph.
+                // Needs a spare pool thread per solver. Only the trimming
+                // checks cancel, an aborted graph returns a ready future.
+                std::shared_future<Cycles> find_cycles_async(
+                        const char* hex_header_hash,
+                        uint32_t hex_header_hash_len,
+                        uint8_t edgeBits,
+                        uint8_t proofSize,
+                        const util::CancelToken& cancel = util::CancelToken{});
+
+                // Batched variant for small graphs, which mostly wait on
+                // barriers when split over threads. Every thread solves
+                // its own graphs with a private single threaded context.
+                // cycles gets an entry per header. Once cancel is cancelled
+                // the graphs in flight give up and no more are started,
+                // their entries stay empty.
+                void find_cycles_batch(
+                        const std::vector<std::string>& hex_header_hashes,
+                        uint8_t edgeBits,
+                        uint8_t proofSize,
+                        std::vector<Cycles>& cycles,
+                        const util::CancelToken& cancel = util::CancelToken{});
+
+                uint8_t edgebits() const;
+
+                // page backing actually obtained for the bucket matrix
+                util::PageBacking page_backing() const;
+                bool allocated() const;
+
+                util::Isa isa() const;
+
+                // engine of the current graph, Auto until one is built
+                Engine engine() const;
+
+                // trimming rounds the last graph took, zero before the first
+                std::uint32_t trim_rounds() const;
+
+                // whether the last find_cycles or find_cycles_async gave up
+                // on its graph, or the last batch on some of its graphs,
+                // because its token was cancelled
+                bool aborted() const;
+
+                // stages of the last graph, null unless options.telemetry
+                // is set and the engine records them
+                const GraphTelemetry* telemetry() const;
+
+            private:
+                void prepare(uint8_t edgeBits, uint8_t proofSize);
+                void prepare_batch(uint8_t edgeBits, uint8_t proofSize);
+
+            private:
+                SolverOptions _options;
+                util::Isa _isa;
+                Engine _engine;
+                std::unique_ptr<solver_base> _ctx;
+                std::vector<std::unique_ptr<solver_base>> _batch;
+                bool _batch_aborted;
+                uint8_t _edgebits;
+                uint8_t _proofsize;
+                size_t _threads;
+                ctpl::thread_pool& _pool;
+        };
     }
 }
 
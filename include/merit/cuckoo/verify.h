@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_CUCKOO_VERIFY_H
+#define MERIT_CUCKOO_VERIFY_H
+
+#include "merit/cuckoo/mean_cuckoo.h"
+
+#include <cstdint>
+
+namespace merit
+{
+    namespace cuckoo
+    {
+        // Why a proof was rejected, Ok when it is a single cycle through
+        // all of its edges.
+        enum class CycleStatus {
+            Ok,
+            WrongSize,
+            EdgeTooBig,
+            NotAscending,
+            NonMatching,
+            Branch,
+            DeadEnd,
+            ShortCycle
+        };
+
+        const char* to_string(CycleStatus);
+
+        const std::uint8_t MAX_PROOF_SIZE = 64;
+
+        // Recomputes the endpoints of the proofSize ascending edges from
+        // the header's siphash keys and follows them around the cycle.
+        // The siphashes run eight at a time on cpus with AVX2.
+        CycleStatus verify_cycle(
+                const char* hex_header_hash,
+                uint32_t hex_header_hash_len,
+                uint8_t edgeBits,
+                const uint32_t* edges,
+                uint8_t proofSize);
+
+        CycleStatus verify_cycle(
+                const char* hex_header_hash,
+                uint32_t hex_header_hash_len,
+                uint8_t edgeBits,
+                uint8_t proofSize,
+                const Cycle& cycle);
+    }
+}
+
+#endif // MERIT_CUCKOO_VERIFY_H
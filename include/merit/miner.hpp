@@ -49,12 +49,115 @@ namespace merit
         int fan_speed;
     };
 
-    bool run_miner(Context*, int workers, int threads_per_worker, const std::vector<int>& gpu_devices);
+    enum class PageBacking { Normal, Transparent, Huge2MB, Huge1GB };
+    enum class Isa { Auto, Scalar, AVX2, AVX512 };
+    enum class Engine { Auto, Mean, Lean };
+    enum class Smt { Pair, Exclude };
+
+    struct MinerOptions
+    {
+        // page size requested for the solver bucket matrix. falls back to
+        // smaller pages when no huge pages are reserved.
+        PageBacking pages = PageBacking::Normal;
+
+        // pin each worker's threads to one NUMA node and allocate its
+        // solver memory there. workers are spread round robin over nodes.
+        bool numa = false;
+
+        // give each worker its own cores sharing a last level cache. with
+        // smt Pair a worker's threads fill both hardware threads of a core,
+        // with Exclude only the first thread of every core is used.
+        bool pin_caches = false;
+        Smt smt = Smt::Pair;
+
+        // simd level of the solver kernels. Auto uses the best level the
+        // cpu supports, forcing a level is mostly useful for benchmarks.
+        Isa isa = Isa::Auto;
+
+        // microseconds solver threads spin at each trimming round before
+        // sleeping. use 0 when other work shares the cores.
+        int barrier_spin_us = 50;
+
+        // Mean is the fast bucket sorting solver, Lean needs about an eighth
+        // of its memory. Auto uses lean for graphs where mean would need
+        // more than memory_budget_mb per worker (0 means no limit).
+        Engine engine = Engine::Auto;
+        int memory_budget_mb = 0;
+
+        // MB the solvers of all cpu workers may use together. workers whose
+        // graphs don't fit are merged into fewer, larger thread teams, and
+        // parked when not even one team fits. 0 means no limit.
+        int total_memory_mb = 0;
+
+        // seconds past a job's time the header time may be rolled once the
+        // job's nonces and extranonce2 are used up. only set it as far as
+        // the pool accepts, 0 never rolls the time.
+        int ntime_roll_s = 0;
+
+        // stop trimming a graph once a pair of rounds removes less than this
+        // share of its edges, 0 always runs the full round count.
+        double trim_stop_rate = 0;
+
+        // per cpu worker overrides of engine, by worker index
+        std::vector<Engine> worker_engines;
+
+        // cpu workers trim the next graph while an extra thread per worker
+        // searches the previous one for cycles
+        bool pipeline = false;
+
+        // search the trimmed graph for cycles on all of a worker's threads.
+        // only pays off on large graphs, small ones are faster serially.
+        bool parallel_cycles = false;
+
+        // graphs with fewer edge bits are solved one per thread, a batch of
+        // consecutive nonces at a time. small graphs split over threads
+        // mostly wait on barriers. every thread holds a graph, so the
+        // memory use grows with the threads. 0 turns batching off.
+        int batch_edgebits = 0;
+
+        // file written by tune_miner. when a job's edge bits are profiled
+        // the cpu workers switch to the tuned layout for them.
+        std::string profile;
+
+        // time each solver stage and count the edges each trimming round
+        // leaves, reported per edge bits in MinerStats::solver
+        bool telemetry = false;
+
+        // write the solver's first rounds through cache line buffers with
+        // streaming stores. pays off with many threads on wide graphs where
+        // memory bandwidth is the limit, costs a little elsewhere.
+        bool streaming_stores = false;
+    };
+
+    bool run_miner(
+            Context*,
+            int workers,
+            int threads_per_worker,
+            const std::vector<int>& gpu_devices,
+            const MinerOptions& options = MinerOptions{});
     void stop_miner(Context*);
+
+    // benchmarks every even split of cores into workers and threads, with
+    // and without batching, on synthetic graphs of each edge bits and
+    // writes the fastest layouts to the profile file.
+    bool tune_miner(
+            int cores,
+            const std::vector<int>& edgebits,
+            int seconds_per_layout,
+            const std::string& profile,
+            const MinerOptions& options = MinerOptions{});
     bool is_stratum_running(Context*);
     bool is_miner_running(Context*);
     bool is_stratum_stopping(Context*);
     bool is_miner_stopping(Context*);
+    // true when cycle is proofsize ascending edges forming a single cycle
+    // in the graph of the header hash
+    bool verify_cycle(
+            const std::string& hex_header_hash,
+            int edgebits,
+            const std::vector<uint32_t>& cycle,
+            int proofsize = 42);
+
     int number_of_cores();
     int number_of_gpus();
     size_t free_memory_on_gpu(int device);
@@ -71,6 +174,35 @@ namespace merit
         int attempts;
         int cycles;
         int shares;
+
+        // graphs dropped because a clean job made them stale, not
+        // counted in attempts
+        int aborted;
+    };
+
+    struct NodeStat
+    {
+        int node;
+        int workers;
+        int attempts;
+        double attempts_per_second;
+    };
+
+    // means per graph. round 0 generates the u nodes, round 1 the v nodes
+    // and the rest trim, ms and edges average over the graphs that ran it.
+    struct RoundStat
+    {
+        double ms;
+        double edges;
+    };
+
+    struct SolverStat
+    {
+        int edgebits;
+        int graphs;
+        double find_ms;
+        double match_ms;
+        std::vector<RoundStat> rounds;
     };
 
     using StatHistory = std::vector<MinerStat>;
@@ -79,6 +211,14 @@ namespace merit
         MinerStat total;
         MinerStat current;
         StatHistory history;
+        std::string page_backing;
+        std::string isa;
+        std::vector<NodeStat> nodes;
+        std::vector<SolverStat> solver;
+
+        // page memory the solvers hold now and the most they held at once
+        int64_t memory_bytes;
+        int64_t peak_memory_bytes;
     };
 
     MinerStats get_miner_stats(Context*);
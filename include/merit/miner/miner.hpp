@@ -39,10 +39,16 @@
 #include <thread>
 #include <chrono>
 #include <deque>
+#include <memory>
+#include <condition_variable>
 #include "merit/util/util.hpp"
 #include "merit/stratum/stratum.hpp"
 #include "merit/miner.hpp"
 #include "merit/ctpl/ctpl.h"
+#include "merit/cuckoo/mean_cuckoo.h"
+#include "merit/util/cancel.hpp"
+#include "merit/miner/profile.hpp"
+#include "merit/miner/nonces.hpp"
 
 #include <boost/optional.hpp>
 
@@ -56,6 +62,46 @@ namespace merit
         size_t CudaGetFreeMemory(int device);
 
         using MaybeStratumJob = boost::optional<stratum::Job>;
+        using MaybePageBacking = boost::optional<util::PageBacking>;
+
+        struct Options
+        {
+            cuckoo::SolverOptions solver;
+
+            // place each cpu worker's threads and memory on one NUMA node
+            bool numa = false;
+
+            // give each cpu worker its own cpus sharing a last level cache,
+            // see util::assign_cpus. with numa the memory follows them.
+            bool pin_caches = false;
+            util::Smt smt = util::Smt::Pair;
+
+            // overrides solver.engine for the cpu worker with the same index
+            std::vector<cuckoo::Engine> worker_engines;
+
+            // cpu workers trim the next graph while a spare pool thread
+            // looks for cycles in the previous one
+            bool pipeline = false;
+
+            // cpu workers solve graphs with fewer edge bits a batch at a
+            // time, one graph per thread. 0 turns batching off.
+            int batch_edgebits = 0;
+
+            // cpu worker layouts tuned per edge bits. the miner switches to
+            // the profiled layout when a job's edge bits change.
+            Profile profile;
+
+            // bytes the solvers of all cpu workers may hold together. when
+            // a job's graphs don't fit, workers are merged into fewer and
+            // larger thread teams, see Miner::admit. 0 means no limit.
+            std::uint64_t memory_limit = 0;
+
+            // seconds past a job's time the header time may be rolled once
+            // its nonces and extranonce2 are used up. pools don't announce
+            // how far they accept it, 0 leaves the time alone.
+            std::uint32_t max_ntime_roll = 0;
+        };
+
         class Miner;
         class Worker
         {
@@ -63,19 +109,29 @@ namespace merit
                 enum State {Running, NotRunning};
 
                 Worker(const Worker& o);
-                Worker(int id, int threads, bool gpu_device, ctpl::thread_pool&, Miner&);
+                Worker(int id, int threads, bool gpu_device, int node, const util::CpuSet& cpus, ctpl::thread_pool&, Miner&);
 
             public:
 
                 int id();
                 void run();
                 State state() const;
+                MaybePageBacking page_backing() const;
+                int node() const;
+                int attempts() const;
+
+            private:
+                void found_cycles(util::Work& work, const cuckoo::Cycles& cycles, const util::CancelToken& cancel);
 
             private:
                 std::atomic<State> _state;
+                std::atomic<int> _page_backing;
+                std::atomic<int> _attempts;
                 int _id;
                 int _threads;
                 bool _gpu_device;
+                int _node;
+                util::CpuSet _cpus;
                 ctpl::thread_pool& _pool;
                 Miner& _miner;
         };
@@ -90,6 +146,10 @@ namespace merit
             std::atomic<int> cycles;
             std::atomic<int> shares;
 
+            // graphs given up on, or whose cycles were dropped, because a
+            // clean job made them stale. not counted in attempts.
+            std::atomic<int> aborted;
+
             Stat();
             Stat(const Stat&);
             Stat& operator=(const Stat&);
@@ -102,19 +162,49 @@ namespace merit
 
         using Stats = std::deque<Stat>;
 
+        struct NodeStat
+        {
+            int node;
+            int workers;
+            int attempts;
+            double seconds;
+
+            double attempts_per_second() const;
+        };
+
+        using NodeStats = std::vector<NodeStat>;
+
+        // Solver stages summed over the graphs of one size, recorded when
+        // options.solver.telemetry is on. Early stopped graphs skip rounds
+        // so each round counts the graphs that ran it.
+        struct StageStat
+        {
+            int graphs = 0;
+            std::vector<double> round_ms;
+            std::vector<double> round_edges;
+            std::vector<int> round_graphs;
+            double find_ms = 0;
+            double match_ms = 0;
+        };
+
+        using StageStats = std::map<int, StageStat>;
+
         class Miner
         {
             public:
-                enum State {Running, Stopping, NotRunning};
+                enum State {Running, Reconfiguring, Stopping, NotRunning};
 
                 Miner(
                         int workers,
                         int threads_per_worker,
                         const std::vector<int>& gpu_devices,
-                        util::SubmitWorkFunc submit_work);
+                        util::SubmitWorkFunc submit_work,
+                        const Options& options = Options{});
                 ~Miner();
 
             public:
+                // a clean job cancels the graphs still being solved for
+                // the previous ones
                 void submit_job(const stratum::Job&);
                 void submit_work(const util::Work&);
                 void clear_job();
@@ -126,9 +216,37 @@ namespace merit
                 bool stopping() const;
 
 
-                util::MaybeWork next_work() const;
+                // bumped on every published job. workers compare it
+                // with the version they hold before taking the snapshot.
+                std::uint64_t work_version() const;
+                WorkSnapshot next_work() const;
+
+                // blocks until a job newer than `version` is published or
+                // the miner leaves Running, at most for the timeout
+                void wait_for_work(std::uint64_t version, std::chrono::milliseconds timeout) const;
+
+                // next range of nonces to mine of the published job, false
+                // when there is no job or nothing of it is left to mine
+                bool lease_nonces(NonceLease&);
+
+                // take before next_work() or lease_nonces() so a job submitted in between
+                // can't slip past the token
+                util::CancelToken cancel_token() const;
 
                 int total_workers() const;
+                const Options& options() const;
+
+                // whether cpu workers solve graphs of this size in batches
+                bool batched(int edgebits) const;
+
+                // smallest page backing obtained by the cpu workers so far
+                MaybePageBacking page_backing() const;
+
+                const util::CpuSet& node_cpus(int node) const;
+                NodeStats node_stats() const;
+
+                void add_telemetry(int edgebits, const cuckoo::GraphTelemetry&);
+                StageStats stage_stats() const;
 
                 //Stats
                 Stats stats() const;
@@ -138,19 +256,38 @@ namespace merit
 
             private:
                 void wait_for_jobs();
+                void publish(WorkSnapshot, const stratum::Job*);
+                void wake_workers();
+                void add_workers(int workers, int threads_per_worker);
+                void relayout(int edgebits);
+                Layout admit(Layout, int edgebits) const;
 
             private:
                 std::atomic<State> _state;
+                std::atomic<std::uint64_t> _epoch;
+                std::atomic<std::uint64_t> _work_version;
+                Options _options;
+                util::NumaNodes _nodes;
+                util::CacheDomains _domains;
                 ctpl::thread_pool _pool;
-                util::MaybeWork _next_work;
+                WorkSnapshot _next_work;
+                NonceManager _nonces;
                 util::SubmitWorkFunc _submit_work;
+                std::vector<int> _gpu_devices;
+                Layout _layout;
+                Layout _next_layout;
+                Layout _wanted_layout;
                 Workers _workers;
                 std::vector<std::future<void>> _jobs;
                 Stats _stats;
                 Stat _total_stats;
                 Stat _current_stat;;
+                StageStats _stage_stats;
                 mutable std::mutex _work_mutex;
+                mutable std::condition_variable _work_cv;
                 mutable std::mutex _stat_mutex;
+                mutable std::mutex _workers_mutex;
+                mutable std::mutex _stage_mutex;
         };
 
 
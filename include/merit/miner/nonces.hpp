@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_MINER_NONCES_H
+#define MERIT_MINER_NONCES_H
+
+#include "merit/util/util.hpp"
+#include "merit/stratum/stratum.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace merit
+{
+    namespace miner
+    {
+        // published jobs are never modified, workers copy the one they
+        // mine on once per job
+        using WorkSnapshot = std::shared_ptr<const util::Work>;
+
+        // A range of nonces [next, end) of one header variant of a job.
+        struct NonceLease
+        {
+            WorkSnapshot work;
+            std::uint64_t version = 0;
+            std::uint64_t next = 0;
+            std::uint64_t end = 0;
+
+            bool empty() const;
+        };
+
+        // Hands out nonce ranges of the current job to workers as they
+        // need them. When the 32 bit nonce space of a header is used up the
+        // extranonce2 in the coinbase is incremented, which gives a new
+        // merkle root and header. Once extranonce2 is exhausted too the
+        // header time is rolled forward, at most max_ntime_roll seconds past
+        // the job's time.
+        class NonceManager
+        {
+            public:
+                NonceManager(std::uint32_t lease_size, std::uint32_t max_ntime_roll);
+
+            public:
+                // work is the job's header as published. a job with the
+                // same header keeps the nonces already handed out.
+                void reset(const stratum::Job&, WorkSnapshot work, std::uint64_t version);
+                void clear(std::uint64_t version);
+
+                // false when there is no job or its nonces, extranonce2 and
+                // ntime are all used up. lease.version is set either way.
+                bool lease(NonceLease&);
+
+            private:
+                bool roll();
+
+            private:
+                std::uint32_t _lease_size;
+                std::uint32_t _max_ntime_roll;
+                stratum::MaybeJob _job;
+                WorkSnapshot _base;
+                WorkSnapshot _work;
+                std::uint64_t _version = 0;
+                std::uint64_t _next = 0;
+                std::uint64_t _xnonce2 = 0;
+                std::uint32_t _ntime_roll = 0;
+                bool _exhausted = false;
+                std::mutex _mutex;
+        };
+    }
+}
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_MINER_PROFILE_H
+#define MERIT_MINER_PROFILE_H
+
+#include "merit/cuckoo/mean_cuckoo.h"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace merit
+{
+    namespace miner
+    {
+        // Worker layout that solved graphs of one size fastest on this host.
+        struct Layout
+        {
+            int workers = 0;
+            int threads_per_worker = 0;
+
+            // each worker solves one graph per thread instead of splitting
+            // one graph over its threads
+            bool batch = false;
+
+            double graphs_per_second = 0;
+        };
+
+        // Tuned layouts by edge bits.
+        using Profile = std::map<int, Layout>;
+
+        // Profiles are text files with a line per edge bits:
+        // edgebits workers threads_per_worker batch graphs_per_second
+        bool load_profile(const std::string& path, Profile& profile);
+        bool save_profile(const std::string& path, const Profile& profile);
+
+        // Solves synthetic graphs of each size with every layout that
+        // splits cores evenly and fits in memory, spending about
+        // per_layout on each, and returns the fastest layout per size.
+        Profile tune(
+                int cores,
+                const std::vector<int>& edgebits,
+                std::chrono::seconds per_layout,
+                const cuckoo::SolverOptions& options);
+    }
+}
+#endif
@@ -34,6 +34,8 @@
 #include <thread>
 #include <random>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <array>
 #include <vector>
 #include <deque>
@@ -102,7 +104,9 @@ namespace merit
 
                 const std::string& get_url();
 
-                MaybeJob get_job();
+                // waits up to `wait` for a job newer than the last one
+                // returned, woken as soon as mining.notify is parsed
+                MaybeJob get_job(std::chrono::milliseconds wait = std::chrono::milliseconds{0});
 
                 void submit_work(const util::Work&);
 
@@ -153,6 +157,7 @@ namespace merit
                 std::atomic<double> _next_diff;
                 mutable std::mutex _sock_mutex;
                 mutable std::mutex _job_mutex;
+                std::condition_variable _job_cv;
 
                 std::vector<unsigned char> _xnonce1;
                 size_t _xnonce2_size;
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_MINER_BARRIER_H
+#define MERIT_MINER_BARRIER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace merit
+{
+    namespace util
+    {
+        const size_t CACHE_LINE = 64;
+
+        // Barrier built on a mutex and condition variable. Every wait takes
+        // the lock and every release goes through the kernel.
+        class BlockingBarrier
+        {
+            public:
+                explicit BlockingBarrier(size_t threads);
+
+                void wait();
+
+            private:
+                std::mutex _mutex;
+                std::condition_variable _cv;
+                size_t _threads;
+                size_t _count;
+                size_t _generation;
+        };
+
+        // Sense reversing barrier. Waiters spin on the generation word for up
+        // to the spin budget and then park on a futex until the last thread
+        // flips it. A zero budget parks right away. The budget is ignored
+        // when the threads outnumber the cores.
+        class SpinBarrier
+        {
+            public:
+                static constexpr std::chrono::microseconds DEFAULT_SPIN{50};
+
+                explicit SpinBarrier(
+                        size_t threads,
+                        std::chrono::microseconds spin = DEFAULT_SPIN);
+
+                SpinBarrier(const SpinBarrier&) = delete;
+                SpinBarrier& operator=(const SpinBarrier&) = delete;
+
+                void wait();
+
+                // like wait(), but the last thread to arrive runs completion
+                // before any thread is released. every waiter sees what it
+                // wrote, which makes it the place for decisions all threads
+                // must agree on.
+                template <typename F>
+                    void wait(F completion)
+                    {
+                        std::uint32_t generation;
+                        if (arrive(generation)) {
+                            completion();
+                            release(generation);
+                        } else {
+                            await(generation);
+                        }
+                    }
+
+                std::chrono::microseconds spin() const;
+
+            private:
+                bool arrive(std::uint32_t& generation);
+                void release(std::uint32_t generation);
+                void await(std::uint32_t generation);
+                void park(std::uint32_t generation);
+                void wake();
+
+            private:
+                const std::uint32_t _threads;
+                const std::chrono::microseconds _spin;
+
+                // each on its own line so arrivals don't disturb the spinners.
+                // the lines are aligned within _lines on construction instead
+                // of with alignas, which plain new ignores before c++17.
+                unsigned char _lines[4 * CACHE_LINE];
+                std::atomic<std::uint32_t>& _count;
+                std::atomic<std::uint32_t>& _generation;
+                std::atomic<std::uint32_t>& _sleepers;
+        };
+    }
+}
+#endif
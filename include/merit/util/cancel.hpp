@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_MINER_CANCEL_H
+#define MERIT_MINER_CANCEL_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace merit
+{
+    namespace util
+    {
+        // Lets a long attempt notice that the job it works on went stale.
+        // The owner of an epoch counter bumps it to cancel every token taken
+        // before. A default constructed token is never cancelled. A check
+        // is one relaxed load, cheap enough for every trimming round.
+        class CancelToken
+        {
+            public:
+                CancelToken() = default;
+
+                explicit CancelToken(const std::atomic<std::uint64_t>& epoch) :
+                    _epoch{&epoch},
+                    _start{epoch.load(std::memory_order_acquire)}
+                {
+                }
+
+                bool cancelled() const
+                {
+                    return _epoch && _epoch->load(std::memory_order_relaxed) != _start;
+                }
+
+            private:
+                const std::atomic<std::uint64_t>* _epoch = nullptr;
+                std::uint64_t _start = 0;
+        };
+    }
+}
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_MINER_CPU_H
+#define MERIT_MINER_CPU_H
+
+namespace merit
+{
+    namespace util
+    {
+        // SIMD levels the kernels are built for, ordered from least to most
+        // capable. Auto picks the best level the cpu supports.
+        enum class Isa { Auto, Scalar, AVX2, AVX512 };
+
+        const char* to_string(Isa);
+
+        // Best level supported by both the cpu and the operating system.
+        Isa detect_isa();
+
+        // Resolves Auto and clamps a forced level to what the cpu supports.
+        Isa resolve_isa(Isa requested);
+
+        // Whether the cpu has the sha256 instructions.
+        bool has_sha_extensions();
+    }
+}
+#endif
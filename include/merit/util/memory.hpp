@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_MINER_MEMORY_H
+#define MERIT_MINER_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace merit
+{
+    namespace util
+    {
+        // ordered from smallest to largest page size
+        enum class PageBacking { Normal, Transparent, Huge2MB, Huge1GB };
+
+        const char* to_string(PageBacking);
+
+        struct Pages
+        {
+            void* data = nullptr;
+            size_t size = 0;
+            PageBacking backing = PageBacking::Normal;
+        };
+
+        // Allocates at least bytes of page aligned memory trying the requested
+        // backing first and falling back to smaller pages when no huge pages
+        // are reserved. The backing actually obtained is returned in Pages.
+        // When node is not negative the pages prefer that NUMA node.
+        Pages allocate_pages(size_t bytes, PageBacking requested, int node = -1);
+        void free_pages(Pages&);
+
+        // bytes held in allocate_pages memory across the process right now,
+        // and the most it has held at once
+        std::uint64_t allocated_bytes();
+        std::uint64_t peak_allocated_bytes();
+    }
+}
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_MINER_SHA256_H
+#define MERIT_MINER_SHA256_H
+
+#include "merit/util/util.hpp"
+
+#include <cstddef>
+
+namespace merit
+{
+    namespace util
+    {
+        // SHA-256 implementations, picked at runtime. Single messages use
+        // the sha extensions when the cpu has them. Batches are hashed
+        // eight at a time in avx2 lanes on cpus without them.
+        enum class Sha256Impl { Auto, Scalar, AVX2, ShaNi };
+
+        const char* to_string(Sha256Impl);
+
+        // Forces an implementation, falling back to scalar where the cpu
+        // lacks it, and Auto restores the default. Call it before any
+        // hashing starts.
+        void select_sha256(Sha256Impl requested);
+
+        // The implementations in use for single messages and batches.
+        Sha256Impl sha256_impl();
+        Sha256Impl sha256_batch_impl();
+
+        void sha256(unsigned char* digest, const unsigned char* data, size_t len);
+
+        // Double sha256 of n messages of len bytes, message i at
+        // data + i * stride. Digest i goes to digests + i * 32.
+        void double_sha256_batch(
+                unsigned char* digests,
+                const unsigned char* data,
+                size_t len,
+                size_t stride,
+                size_t n);
+
+        // The same for messages sharing the first 64 bytes in the midstate
+        // and differing in the len < 56 bytes after them.
+        void double_sha256_batch(
+                unsigned char* digests,
+                const Sha256Midstate& midstate,
+                const unsigned char* tails,
+                size_t len,
+                size_t stride,
+                size_t n);
+    }
+}
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_MINER_TOPOLOGY_H
+#define MERIT_MINER_TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+namespace merit
+{
+    namespace util
+    {
+        using CpuSet = std::vector<int>;
+
+        struct NumaNode
+        {
+            int id;
+            CpuSet cpus;
+        };
+
+        using NumaNodes = std::vector<NumaNode>;
+
+        // Cores sharing a last level cache. Each core lists its hardware
+        // threads, the SMT siblings, lowest cpu first.
+        struct CacheDomain
+        {
+            int node;
+            std::vector<CpuSet> cores;
+        };
+
+        using CacheDomains = std::vector<CacheDomain>;
+
+        // How a worker's cpus treat SMT siblings. Pair gives a worker both
+        // threads of its cores so one graph shares each core, Exclude only
+        // uses the first thread of every core.
+        enum class Smt { Pair, Exclude };
+
+        const char* to_string(Smt);
+
+        // parses a kernel cpu list such as "0-3,8-11"
+        CpuSet parse_cpu_list(const std::string&);
+
+        // formats cpus the same way, runs collapsed into ranges
+        std::string to_cpu_list(const CpuSet&);
+
+        // Reads the NUMA topology from /sys/devices/system/node. When it is
+        // not available a single node 0 with every cpu is returned.
+        NumaNodes numa_nodes();
+
+        // Reads the last level caches and SMT siblings of the online cpus
+        // from /sys/devices/system/cpu. When they are not available every
+        // cpu is a core of its own in a single domain.
+        CacheDomains cache_domains();
+
+        // Gives each of workers its own threads cpus, taken a core at a
+        // time from one cache domain while one has room. Workers only span
+        // domains, or share cpus, when there are not enough left.
+        std::vector<CpuSet> assign_cpus(
+                const CacheDomains&,
+                int workers,
+                int threads,
+                Smt);
+
+        // Pins the calling thread to the cpus. Repinning to the set the
+        // thread is already pinned to is free.
+        bool pin_thread(const CpuSet&);
+
+        // Pins the calling thread to the cpus while in scope and then
+        // restores the cpus it ran on before. Pool threads are shared by
+        // all workers, jobs pin them only for as long as they run.
+        class ScopedPin
+        {
+            public:
+                explicit ScopedPin(const CpuSet&);
+                ~ScopedPin();
+
+                ScopedPin(const ScopedPin&) = delete;
+                ScopedPin& operator=(const ScopedPin&) = delete;
+
+                // whether the thread runs on the cpus
+                bool pinned() const;
+
+            private:
+                CpuSet _previous;
+                bool _pinned = false;
+                bool _restore = false;
+        };
+    }
+}
+#endif
@@ -32,6 +32,7 @@
 #define MERIT_MINER_UTIL_H
 
 #include <vector>
+#include <array>
 #include <string>
 #include <sstream>
 #include <cstdint>
@@ -170,6 +171,19 @@ namespace merit
                 unsigned char* digest,
                 const unsigned char* data,
                 size_t len);
+
+        // sha256 state after a message's first 64 byte block
+        using Sha256Midstate = std::array<uint32_t, 8>;
+
+        Sha256Midstate sha256_midstate(const unsigned char* block);
+
+        // double sha256 of a message whose first 64 bytes are in the
+        // midstate. the remaining len bytes have to fit one block, len < 56.
+        void double_sha256(
+                unsigned char* digest,
+                const Sha256Midstate& midstate,
+                const unsigned char* tail,
+                size_t len);
     }
 }
 #endif
@@ -47,6 +47,10 @@ namespace merit
         {
             std::string jobid;
             std::array<uint32_t, 32> data;
+
+            // over the first 64 big endian header bytes, which the nonce
+            // doesn't touch. see update_midstate().
+            Sha256Midstate midstate;
             std::array<uint32_t, 8> target;
             std::array<uint32_t, 42> cycle;
 
@@ -59,6 +63,9 @@ namespace merit
             util::ubytes xnonce2;
         };
 
+        // call after changing any of data[0..15]
+        void update_midstate(Work&);
+
         using MaybeWork = boost::optional<Work>;
         using SubmitWorkFunc = std::function<void(const Work&)> ;
     }
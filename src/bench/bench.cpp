@@ -0,0 +1,739 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/cuckoo/mean_cuckoo.h"
+#include "merit/cuckoo/verify.h"
+#include "merit/util/barrier.hpp"
+#include "merit/util/sha256.hpp"
+#include "merit/crypto/blake2b.h"
+#include "merit/blake2/blake2.h"
+#include "merit/termcolor/termcolor.hpp"
+#include "merit/PicoSHA2/picosha2.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+using namespace merit;
+
+// Runs rounds of a small busy loop separated by barrier waits, the same
+// shape as the late trimming rounds, and returns nanoseconds per round.
+template <typename B>
+double time_barrier(B& barrier, int threads, int rounds, int work)
+{
+    std::vector<std::thread> pool;
+    const auto start = std::chrono::steady_clock::now();
+    for(int t = 0; t < threads; t++) {
+        pool.emplace_back([&barrier, rounds, work] {
+                volatile int sink = 0;
+                for(int r = 0; r < rounds; r++) {
+                    for(int i = 0; i < work; i++) {
+                        sink = sink + i;
+                    }
+                    barrier.wait();
+                }
+        });
+    }
+    for(auto& t : pool) {
+        t.join();
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / rounds;
+}
+
+int bench_barrier(int threads, int rounds, int work, int spin_us)
+{
+    std::cout << "info :: barrier threads: " << termcolor::cyan << threads << termcolor::reset
+              << " rounds: " << termcolor::cyan << rounds << termcolor::reset
+              << " work: " << termcolor::cyan << work << termcolor::reset << std::endl;
+
+    util::BlockingBarrier blocking{static_cast<size_t>(threads)};
+    const double blocking_ns = time_barrier(blocking, threads, rounds, work);
+    std::cout << "info :: blocking: " << termcolor::cyan << blocking_ns << termcolor::reset << " ns/round" << std::endl;
+
+    util::SpinBarrier spin{static_cast<size_t>(threads), std::chrono::microseconds{spin_us}};
+    const double spin_ns = time_barrier(spin, threads, rounds, work);
+    std::cout << "info :: spin " << spin.spin().count() << "us: " << termcolor::cyan << spin_ns << termcolor::reset << " ns/round"
+              << " (" << blocking_ns / spin_ns << "x)" << std::endl;
+    return 0;
+}
+
+// Solves graphs 0..graphs-1 and returns ms per graph, the cycles of each
+// graph and the trimming rounds they took in total.
+double time_solver(
+        const cuckoo::SolverOptions& options,
+        int threads,
+        int edgebits,
+        int graphs,
+        std::vector<cuckoo::Cycles>& found,
+        std::uint64_t& rounds)
+{
+    ctpl::thread_pool pool{threads};
+    cuckoo::Solver solver{static_cast<size_t>(threads), pool, options};
+
+    const auto start = std::chrono::steady_clock::now();
+    for(int g = 0; g < graphs; g++) {
+        char header[65];
+        std::snprintf(header, sizeof(header), "%064x", g);
+        cuckoo::Cycles cycles;
+        solver.find_cycles(header, 64, edgebits, 42, cycles);
+        found.push_back(cycles);
+        rounds += solver.trim_rounds();
+    }
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / graphs;
+}
+
+// Solves the same graphs with the serial and the parallel cycle search. They
+// share the trimming so the difference per graph is the serial tail saved.
+int bench_cycles(int threads, int edgebits, int graphs)
+{
+    std::cout << "info :: cycles threads: " << termcolor::cyan << threads << termcolor::reset
+              << " edgebits: " << termcolor::cyan << edgebits << termcolor::reset
+              << " graphs: " << termcolor::cyan << graphs << termcolor::reset << std::endl;
+
+    cuckoo::SolverOptions options;
+    options.engine = cuckoo::Engine::Mean;
+
+    options.parallel_cycles = false;
+    std::vector<cuckoo::Cycles> serial_cycles;
+    std::uint64_t rounds = 0;
+    const double serial_ms = time_solver(options, threads, edgebits, graphs, serial_cycles, rounds);
+    std::cout << "info :: serial search: " << termcolor::cyan << serial_ms << termcolor::reset << " ms/graph" << std::endl;
+
+    options.parallel_cycles = true;
+    std::vector<cuckoo::Cycles> parallel_cycles;
+    const double parallel_ms = time_solver(options, threads, edgebits, graphs, parallel_cycles, rounds);
+    std::cout << "info :: parallel search: " << termcolor::cyan << parallel_ms << termcolor::reset << " ms/graph"
+              << " (" << serial_ms - parallel_ms << " ms saved)" << std::endl;
+
+    if(serial_cycles != parallel_cycles) {
+        std::cerr << termcolor::red << "error :: the parallel search found different cycles" << termcolor::reset << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Solves the same graphs with the fixed round count and with rounds stopped
+// at the given rate, and counts the graphs whose cycles differ.
+int bench_trims(int threads, int edgebits, int graphs, double rate)
+{
+    std::cout << "info :: trims threads: " << termcolor::cyan << threads << termcolor::reset
+              << " edgebits: " << termcolor::cyan << edgebits << termcolor::reset
+              << " graphs: " << termcolor::cyan << graphs << termcolor::reset
+              << " stop rate: " << termcolor::cyan << rate << termcolor::reset << std::endl;
+
+    cuckoo::SolverOptions options;
+    options.engine = cuckoo::Engine::Mean;
+
+    std::vector<cuckoo::Cycles> fixed_cycles;
+    std::uint64_t fixed_rounds = 0;
+    const double fixed_ms = time_solver(options, threads, edgebits, graphs, fixed_cycles, fixed_rounds);
+    std::cout << "info :: fixed: " << termcolor::cyan << fixed_ms << termcolor::reset << " ms/graph, "
+              << termcolor::cyan << static_cast<double>(fixed_rounds) / graphs << termcolor::reset << " rounds/graph" << std::endl;
+
+    options.trim_stop_rate = rate;
+    std::vector<cuckoo::Cycles> adaptive_cycles;
+    std::uint64_t adaptive_rounds = 0;
+    const double adaptive_ms = time_solver(options, threads, edgebits, graphs, adaptive_cycles, adaptive_rounds);
+    std::cout << "info :: adaptive: " << termcolor::cyan << adaptive_ms << termcolor::reset << " ms/graph, "
+              << termcolor::cyan << static_cast<double>(adaptive_rounds) / graphs << termcolor::reset << " rounds/graph" << std::endl;
+
+    int cycles = 0;
+    int differ = 0;
+    for(int g = 0; g < graphs; g++) {
+        cycles += fixed_cycles[g].size();
+        if(fixed_cycles[g] != adaptive_cycles[g]) {
+            differ++;
+        }
+    }
+    std::cout << "info :: cycles: " << termcolor::cyan << cycles << termcolor::reset
+              << " graphs with different cycles: " << (differ ? termcolor::yellow : termcolor::cyan) << differ << termcolor::reset << std::endl;
+    return 0;
+}
+
+// Solves the same graphs split over all threads and as batches with one
+// graph per thread, and reports graphs per second of each.
+int bench_batch(int threads, int edgebits, int graphs)
+{
+    std::cout << "info :: batch threads: " << termcolor::cyan << threads << termcolor::reset
+              << " edgebits: " << termcolor::cyan << edgebits << termcolor::reset
+              << " graphs: " << termcolor::cyan << graphs << termcolor::reset << std::endl;
+
+    cuckoo::SolverOptions options;
+    options.engine = cuckoo::Engine::Mean;
+
+    std::vector<cuckoo::Cycles> split_cycles;
+    std::uint64_t rounds = 0;
+    const double split_ms = time_solver(options, threads, edgebits, graphs, split_cycles, rounds);
+    std::cout << "info :: split: " << termcolor::cyan << 1000 / split_ms << termcolor::reset << " graphs/s" << std::endl;
+
+    ctpl::thread_pool pool{threads};
+    cuckoo::Solver solver{static_cast<size_t>(threads), pool, options};
+    std::vector<cuckoo::Cycles> batch_cycles;
+
+    const auto start = std::chrono::steady_clock::now();
+    for(int g = 0; g < graphs; g += threads) {
+        std::vector<std::string> headers;
+        for(int i = g; i < graphs && i < g + threads; i++) {
+            char header[65];
+            std::snprintf(header, sizeof(header), "%064x", i);
+            headers.push_back(header);
+        }
+        std::vector<cuckoo::Cycles> cycles;
+        solver.find_cycles_batch(headers, edgebits, 42, cycles);
+        batch_cycles.insert(batch_cycles.end(), cycles.begin(), cycles.end());
+    }
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    const double batch_ms = elapsed.count() / graphs;
+    std::cout << "info :: batched: " << termcolor::cyan << 1000 / batch_ms << termcolor::reset << " graphs/s"
+              << " (" << split_ms / batch_ms << "x)" << std::endl;
+
+    if(split_cycles != batch_cycles) {
+        std::cerr << termcolor::red << "error :: the batched solver found different cycles" << termcolor::reset << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Solves the same graphs with plain bucket scatters and with write combined
+// streaming stores, and reports ms per graph of each.
+int bench_stores(int threads, int edgebits, int graphs)
+{
+    std::cout << "info :: stores threads: " << termcolor::cyan << threads << termcolor::reset
+              << " edgebits: " << termcolor::cyan << edgebits << termcolor::reset
+              << " graphs: " << termcolor::cyan << graphs << termcolor::reset << std::endl;
+
+    cuckoo::SolverOptions options;
+    options.engine = cuckoo::Engine::Mean;
+
+    std::vector<cuckoo::Cycles> plain_cycles;
+    std::uint64_t rounds = 0;
+    const double plain_ms = time_solver(options, threads, edgebits, graphs, plain_cycles, rounds);
+    std::cout << "info :: plain: " << termcolor::cyan << plain_ms << termcolor::reset << " ms/graph" << std::endl;
+
+    options.streaming_stores = true;
+    std::vector<cuckoo::Cycles> streaming_cycles;
+    const double streaming_ms = time_solver(options, threads, edgebits, graphs, streaming_cycles, rounds);
+    std::cout << "info :: streaming: " << termcolor::cyan << streaming_ms << termcolor::reset << " ms/graph"
+              << " (" << plain_ms / streaming_ms << "x)" << std::endl;
+
+    if(plain_cycles != streaming_cycles) {
+        std::cerr << termcolor::red << "error :: streaming stores found different cycles" << termcolor::reset << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Solves graphs until some cycles turn up, then verifies them over and over
+// and checks that a proof with one edge changed is rejected.
+int bench_verify(int threads, int edgebits, int graphs, int rounds)
+{
+    std::cout << "info :: verify edgebits: " << termcolor::cyan << edgebits << termcolor::reset
+              << " graphs: " << termcolor::cyan << graphs << termcolor::reset
+              << " rounds: " << termcolor::cyan << rounds << termcolor::reset << std::endl;
+
+    std::vector<cuckoo::Cycles> found;
+    std::uint64_t trims = 0;
+    time_solver(cuckoo::SolverOptions{}, threads, edgebits, graphs, found, trims);
+
+    std::vector<std::pair<std::string, cuckoo::Cycle>> proofs;
+    for(int g = 0; g < graphs; g++) {
+        char header[65];
+        std::snprintf(header, sizeof(header), "%064x", g);
+        for(const auto& cycle : found[g]) {
+            proofs.emplace_back(header, cycle);
+        }
+    }
+
+    if(proofs.empty()) {
+        std::cerr << termcolor::red << "error :: no cycles found, solve more graphs" << termcolor::reset << std::endl;
+        return 1;
+    }
+
+    for(const auto& p : proofs) {
+        auto corrupt = p.second;
+        const auto last = *corrupt.rbegin();
+        corrupt.erase(last);
+        corrupt.insert(last + 1);
+        if(cuckoo::verify_cycle(p.first.data(), 64, edgebits, 42, corrupt) == cuckoo::CycleStatus::Ok) {
+            std::cerr << termcolor::red << "error :: a corrupted cycle verified" << termcolor::reset << std::endl;
+            return 1;
+        }
+    }
+
+    int invalid = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for(int r = 0; r < rounds; r++) {
+        for(const auto& p : proofs) {
+            invalid += cuckoo::verify_cycle(p.first.data(), 64, edgebits, 42, p.second) != cuckoo::CycleStatus::Ok;
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "info :: verified: " << termcolor::cyan << rounds * proofs.size() / elapsed.count() << termcolor::reset << " cycles/s" << std::endl;
+
+    if(invalid) {
+        std::cerr << termcolor::red << "error :: " << invalid << " solver cycles failed to verify" << termcolor::reset << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// 64 hex digits drawn from seed and index with splitmix64, so every host
+// and build solves the same graphs
+std::string seeded_header(std::uint64_t seed, int index)
+{
+    std::uint64_t x = seed ^ (0x9e3779b97f4a7c15ULL * (index + 1));
+    std::string header;
+    for(int i = 0; i < 4; i++) {
+        std::uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        char word[17];
+        std::snprintf(word, sizeof(word), "%016llx", static_cast<unsigned long long>(z));
+        header += word;
+    }
+    return header;
+}
+
+long peak_rss_kb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Solves the same seeded graphs for every edge bits in the range and prints
+// the results as JSON on stdout. The first graph of each size is solved an
+// extra time untimed so the memory is allocated before the clock starts.
+// The checksum covers every cycle found, equal checksums mean two builds
+// found the same cycles.
+int bench_solver(int threads, int min_edgebits, int max_edgebits, int graphs, std::uint64_t seed)
+{
+    using ms = std::chrono::duration<double, std::milli>;
+
+    cuckoo::SolverOptions options;
+    options.telemetry = true;
+
+    ctpl::thread_pool pool{threads};
+    std::vector<std::string> headers;
+    for(int g = 0; g < graphs; g++) {
+        headers.push_back(seeded_header(seed, g));
+    }
+
+    std::cout << "{" << std::endl
+              << "  \"threads\": " << threads << "," << std::endl
+              << "  \"seed\": " << seed << "," << std::endl
+              << "  \"graphs\": " << graphs << "," << std::endl
+              << "  \"isa\": \"" << util::to_string(cuckoo::select_isa(options.isa)) << "\"," << std::endl
+              << "  \"results\": [";
+
+    for(int edgebits = min_edgebits; edgebits <= max_edgebits; edgebits++) {
+        std::cerr << "info :: solver edgebits: " << termcolor::cyan << edgebits << termcolor::reset << std::endl;
+
+        cuckoo::Solver solver{static_cast<size_t>(threads), pool, options};
+        cuckoo::Cycles warmup;
+        solver.find_cycles(headers[0].data(), headers[0].size(), edgebits, 42, warmup);
+
+        int cycles = 0;
+        std::uint64_t checksum = 0xcbf29ce484222325ULL;
+        double find_ms = 0;
+        double match_ms = 0;
+        std::vector<double> round_ms;
+        std::vector<double> round_edges;
+
+        const auto start = std::chrono::steady_clock::now();
+        for(const auto& header : headers) {
+            cuckoo::Cycles found;
+            solver.find_cycles(header.data(), header.size(), edgebits, 42, found);
+            for(const auto& cycle : found) {
+                cycles++;
+                for(const auto edge : cycle) {
+                    checksum = (checksum ^ edge) * 0x100000001b3ULL;
+                }
+            }
+
+            if(const auto t = solver.telemetry()) {
+                find_ms += ms{t->find_time}.count();
+                match_ms += ms{t->match_time}.count();
+                if(round_ms.size() < t->round_time.size()) {
+                    round_ms.resize(t->round_time.size(), 0);
+                    round_edges.resize(t->round_time.size(), 0);
+                }
+                for(size_t r = 0; r < t->round_time.size(); r++) {
+                    round_ms[r] += ms{t->round_time[r]}.count();
+                    round_edges[r] += t->round_edges[r];
+                }
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        char sum[17];
+        std::snprintf(sum, sizeof(sum), "%016llx", static_cast<unsigned long long>(checksum));
+        std::cout << (edgebits == min_edgebits ? "" : ",") << std::endl
+                  << "    {" << std::endl
+                  << "      \"edgebits\": " << edgebits << "," << std::endl
+                  << "      \"engine\": \"" << cuckoo::to_string(solver.engine()) << "\"," << std::endl
+                  << "      \"seconds\": " << elapsed.count() << "," << std::endl
+                  << "      \"graphs_per_second\": " << graphs / elapsed.count() << "," << std::endl
+                  << "      \"cycles\": " << cycles << "," << std::endl
+                  << "      \"checksum\": \"" << sum << "\"," << std::endl
+                  << "      \"find_ms\": " << find_ms / graphs << "," << std::endl
+                  << "      \"match_ms\": " << match_ms / graphs << "," << std::endl
+                  << "      \"rounds\": [";
+        for(size_t r = 0; r < round_ms.size(); r++) {
+            std::cout << (r ? ", " : "") << "{\"ms\": " << round_ms[r] / graphs << ", \"edges\": " << round_edges[r] / graphs << "}";
+        }
+        std::cout << "]," << std::endl
+                  << "      \"solver_memory_mb\": " << (util::allocated_bytes() >> 20) << "," << std::endl
+                  << "      \"peak_rss_mb\": " << peak_rss_kb() / 1024 << std::endl
+                  << "    }";
+    }
+
+    std::cout << std::endl
+              << "  ]," << std::endl
+              << "  \"peak_rss_mb\": " << peak_rss_kb() / 1024 << std::endl
+              << "}" << std::endl;
+    return 0;
+}
+
+std::vector<unsigned char> pico_double_sha256(const unsigned char* data, size_t len)
+{
+    std::vector<unsigned char> first(picosha2::k_digest_size);
+    std::vector<unsigned char> second(picosha2::k_digest_size);
+    picosha2::hash256(data, data + len, first.begin(), first.end());
+    picosha2::hash256(first.begin(), first.end(), second.begin(), second.end());
+    return second;
+}
+
+// Compares the implementation in use with PicoSHA2, on its test vectors and
+// on random messages through every entry point, and returns the mismatches.
+int check_sha256()
+{
+    const std::vector<std::pair<std::string, std::string>> vectors = {
+        {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"The quick brown fox jumps over the lazy dog", "d7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592"},
+        {"The quick brown fox jumps over the lazy dog.", "ef537f25c895bfa782526529a9b63d97aa631564d5d789c2b765448c8635fb6c"},
+        {"For this sample, this 63-byte string will be used as input data", "f08a78cbbaee082b052ae0708f32fa1e50c5c421aa772ba5dbb406a2ea6be342"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        {"This is exactly 64 bytes long, not counting the terminating byte", "ab64eff7e88e2e46165e29f2bce41826bd4c7b3552f6b382a9e7d3af47c245f8"},
+        {"This is exactly 64 bytes long, not counting the terminati", "46db250ef6d667908de17333c25343778f495d7a8010b9cfa2af97940772e8cd"},
+        {"This is exactly 64 bytes long, not counting the terminatin", "af38fc14dbbbcc6cd4c9cc73988e1b08373b4e6b04ba61b41f999731185b51af"},
+        {"This is exactly 64 bytes long, not counting the terminating", "f778b361f650cdd9981ca13adb77f26b8419a407b3938fc54b14e9971045fa9d"},
+        {"This is exactly 64 bytes long, not counting the terminating b", "9aa72d139c7d7e5a35ea525e2ba6704163555ba647927765a61ccbf12ec60479"},
+    };
+
+    int failed = 0;
+    for(const auto& v : vectors) {
+        std::array<unsigned char, 32> digest;
+        util::sha256(digest.data(), reinterpret_cast<const unsigned char*>(v.first.data()), v.first.size());
+        std::string hex;
+        util::to_hex(digest, hex);
+        failed += hex != v.second;
+    }
+
+    std::mt19937 rng{42};
+    const size_t n = 11;
+    for(size_t len = 0; len < 300; len++) {
+        std::vector<unsigned char> data(n * (len + 64));
+        for(auto& b : data) {
+            b = rng();
+        }
+
+        std::vector<unsigned char> digests(n * 32);
+        util::double_sha256(digests.data(), data.data(), len);
+        failed += std::memcmp(digests.data(), pico_double_sha256(data.data(), len).data(), 32) != 0;
+
+        util::double_sha256_batch(digests.data(), data.data(), len, len + 64, n);
+        for(size_t i = 0; i < n; i++) {
+            failed += std::memcmp(&digests[i * 32], pico_double_sha256(&data[i * (len + 64)], len).data(), 32) != 0;
+        }
+
+        if(len >= 56) {
+            continue;
+        }
+
+        // the messages share the first block, the tails follow at a stride
+        std::vector<unsigned char> message(data.begin(), data.begin() + 64 + len);
+        const auto midstate = util::sha256_midstate(data.data());
+        util::double_sha256(digests.data(), midstate, &data[64], len);
+        failed += std::memcmp(digests.data(), pico_double_sha256(message.data(), message.size()).data(), 32) != 0;
+
+        util::double_sha256_batch(digests.data(), midstate, &data[64], len, len + 64, n);
+        for(size_t i = 0; i < n; i++) {
+            std::copy(&data[64 + i * (len + 64)], &data[64 + i * (len + 64)] + len, message.begin() + 64);
+            failed += std::memcmp(&digests[i * 32], pico_double_sha256(message.data(), message.size()).data(), 32) != 0;
+        }
+    }
+    return failed;
+}
+
+// Checks each sha256 implementation the cpu has against PicoSHA2, then times
+// the header attempts the workers hash, singly and eight at a time, and the
+// 169 byte cycle hashes.
+int bench_sha256(int rounds)
+{
+    using ns = std::chrono::duration<double, std::nano>;
+
+    std::cout << "info :: sha256 rounds: " << termcolor::cyan << rounds << termcolor::reset << std::endl;
+
+    std::array<unsigned char, 64> head;
+    std::array<std::array<uint32_t, 5>, 8> tails;
+    std::array<unsigned char, 169> cycle;
+    head.fill(1);
+    cycle.fill(2);
+    for(auto& t : tails) {
+        t.fill(3);
+    }
+    const auto midstate = util::sha256_midstate(head.data());
+
+    int failed = 0;
+    for(const auto impl : {util::Sha256Impl::Scalar, util::Sha256Impl::AVX2, util::Sha256Impl::ShaNi}) {
+        util::select_sha256(impl);
+        if(impl != util::Sha256Impl::Scalar && util::sha256_impl() != impl && util::sha256_batch_impl() != impl) {
+            std::cout << "info :: " << util::to_string(impl) << ": " << termcolor::yellow << "not supported" << termcolor::reset << std::endl;
+            continue;
+        }
+
+        const int mismatches = check_sha256();
+        failed += mismatches;
+
+        std::array<unsigned char, 32 * 8> digests;
+        auto start = std::chrono::steady_clock::now();
+        for(int r = 0; r < rounds; r++) {
+            tails[0][3] = r;
+            util::double_sha256(digests.data(), midstate, reinterpret_cast<const unsigned char*>(tails[0].data()), 17);
+        }
+        const double header_ns = ns{std::chrono::steady_clock::now() - start}.count() / rounds;
+
+        start = std::chrono::steady_clock::now();
+        for(int r = 0; r < rounds; r += 8) {
+            for(int i = 0; i < 8; i++) {
+                tails[i][3] = r + i;
+            }
+            util::double_sha256_batch(digests.data(), midstate, reinterpret_cast<const unsigned char*>(tails.data()), 17, sizeof(tails[0]), 8);
+        }
+        const double batch_ns = ns{std::chrono::steady_clock::now() - start}.count() / rounds;
+
+        start = std::chrono::steady_clock::now();
+        for(int r = 0; r < rounds; r++) {
+            cycle[1] = r;
+            util::double_sha256(digests.data(), cycle.data(), cycle.size());
+        }
+        const double cycle_ns = ns{std::chrono::steady_clock::now() - start}.count() / rounds;
+
+        std::cout << "info :: " << util::to_string(impl) << ": headers " << termcolor::cyan << header_ns << termcolor::reset << " ns"
+                  << " batched " << termcolor::cyan << batch_ns << termcolor::reset << " ns"
+                  << " cycles " << termcolor::cyan << cycle_ns << termcolor::reset << " ns"
+                  << (mismatches ? " mismatches: " : "") << (mismatches ? std::to_string(mismatches) : "") << std::endl;
+    }
+    util::select_sha256(util::Sha256Impl::Auto);
+
+    if(failed) {
+        std::cerr << termcolor::red << "error :: sha256 differs from PicoSHA2" << termcolor::reset << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Compares the implementation in use with the reference code on random
+// messages, singly and in batches, and returns the mismatches.
+int check_blake2b()
+{
+    std::mt19937 rng{42};
+    const size_t n = 7;
+    int failed = 0;
+    for(size_t len = 0; len < 400; len++) {
+        std::vector<std::vector<unsigned char>> messages(n, std::vector<unsigned char>(len + 1));
+        std::vector<const unsigned char*> ptrs;
+        for(auto& m : messages) {
+            for(auto& b : m) {
+                b = rng();
+            }
+            ptrs.push_back(m.data());
+        }
+
+        for(const size_t outlen : {16, 32, 64}) {
+            std::vector<unsigned char> digests(n * outlen);
+            std::vector<unsigned char> expected(outlen);
+            ::blake2b(expected.data(), outlen, messages[0].data(), len, nullptr, 0);
+            crypto::blake2b(digests.data(), outlen, messages[0].data(), len);
+            failed += std::memcmp(digests.data(), expected.data(), outlen) != 0;
+
+            crypto::blake2b_batch(digests.data(), outlen, ptrs.data(), len, n);
+            for(size_t i = 0; i < n; i++) {
+                ::blake2b(expected.data(), outlen, messages[i].data(), len, nullptr, 0);
+                failed += std::memcmp(&digests[i * outlen], expected.data(), outlen) != 0;
+            }
+        }
+    }
+    return failed;
+}
+
+// Checks each blake2b implementation the cpu has against the reference code,
+// then times the siphash key derivation from 64 byte header hashes, singly
+// and four at a time.
+int bench_blake2b(int rounds)
+{
+    using ns = std::chrono::duration<double, std::nano>;
+
+    std::cout << "info :: blake2b rounds: " << termcolor::cyan << rounds << termcolor::reset << std::endl;
+
+    std::array<std::array<unsigned char, 64>, 4> headers;
+    std::array<const unsigned char*, 4> ptrs;
+    for(size_t i = 0; i < headers.size(); i++) {
+        headers[i].fill('a' + i);
+        ptrs[i] = headers[i].data();
+    }
+
+    int failed = 0;
+    for(const auto impl : {crypto::Blake2bImpl::Ref, crypto::Blake2bImpl::AVX2}) {
+        crypto::select_blake2b(impl);
+        if(crypto::blake2b_impl() != impl) {
+            std::cout << "info :: " << crypto::to_string(impl) << ": " << termcolor::yellow << "not supported" << termcolor::reset << std::endl;
+            continue;
+        }
+
+        const int mismatches = check_blake2b();
+        failed += mismatches;
+
+        std::array<unsigned char, 32 * 4> keys;
+        auto start = std::chrono::steady_clock::now();
+        for(int r = 0; r < rounds; r++) {
+            headers[0][0] = r;
+            crypto::blake2b(keys.data(), 32, headers[0].data(), headers[0].size());
+        }
+        const double single_ns = ns{std::chrono::steady_clock::now() - start}.count() / rounds;
+
+        start = std::chrono::steady_clock::now();
+        for(int r = 0; r < rounds; r += 4) {
+            headers[0][0] = r;
+            crypto::blake2b_batch(keys.data(), 32, ptrs.data(), headers[0].size(), ptrs.size());
+        }
+        const double batch_ns = ns{std::chrono::steady_clock::now() - start}.count() / rounds;
+
+        std::cout << "info :: " << crypto::to_string(impl) << ": headers " << termcolor::cyan << single_ns << termcolor::reset << " ns"
+                  << " batched " << termcolor::cyan << batch_ns << termcolor::reset << " ns"
+                  << (mismatches ? " mismatches: " : "") << (mismatches ? std::to_string(mismatches) : "") << std::endl;
+    }
+    crypto::select_blake2b(crypto::Blake2bImpl::Auto);
+
+    if(failed) {
+        std::cerr << termcolor::red << "error :: blake2b differs from the reference" << termcolor::reset << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    po::options_description desc("Allowed options");
+    std::string mode;
+    int threads;
+    int rounds;
+    int work;
+    int spin;
+    int edgebits;
+    int max_edgebits;
+    int graphs;
+    std::uint64_t seed;
+    double trim_stop;
+    desc.add_options()
+        ("help,h", "show the help message")
+        ("mode", po::value<std::string>(&mode)->default_value("barrier"), "What to benchmark: barrier, cycles, trims, batch, verify, stores, solver, sha256 or blake2b.")
+        ("threads,t", po::value<int>(&threads)->default_value(std::max(2u, std::thread::hardware_concurrency())), "Number of threads.")
+        ("rounds", po::value<int>(&rounds)->default_value(100000), "Number of barrier rounds, passes over the cycles for verify, or hashes for sha256 and blake2b.")
+        ("work", po::value<int>(&work)->default_value(1000), "Loop iterations each thread runs between barriers.")
+        ("spin", po::value<int>(&spin)->default_value(util::SpinBarrier::DEFAULT_SPIN.count()), "Spin budget of the spin barrier in microseconds.")
+        ("edgebits", po::value<int>(&edgebits)->default_value(24), "Graph size of the solver benchmarks.")
+        ("max-edgebits", po::value<int>(&max_edgebits)->default_value(0), "Last graph size the solver benchmark runs, starting at --edgebits. Defaults to --edgebits.")
+        ("graphs", po::value<int>(&graphs)->default_value(10), "Number of graphs the solver benchmarks solve.")
+        ("seed", po::value<std::uint64_t>(&seed)->default_value(0), "Seed of the headers the solver benchmark solves.")
+        ("trim-stop", po::value<double>(&trim_stop)->default_value(0.05), "Stop rate the trims benchmark compares with the fixed round count.");
+
+    po::positional_options_description positional;
+    positional.add("mode", 1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+    po::notify(vm);
+
+    if(vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    if(threads < 1 || rounds < 1 || graphs < 1) {
+        std::cerr << termcolor::red << "error :: threads, rounds and graphs must be positive" << termcolor::reset << std::endl;
+        return 1;
+    }
+
+    if(mode == "barrier") {
+        return bench_barrier(threads, rounds, work, spin);
+    }
+    if(mode == "cycles") {
+        return bench_cycles(threads, edgebits, graphs);
+    }
+    if(mode == "trims") {
+        return bench_trims(threads, edgebits, graphs, trim_stop);
+    }
+    if(mode == "batch") {
+        return bench_batch(threads, edgebits, graphs);
+    }
+    if(mode == "stores") {
+        return bench_stores(threads, edgebits, graphs);
+    }
+    if(mode == "verify") {
+        return bench_verify(threads, edgebits, graphs, rounds);
+    }
+    if(mode == "blake2b") {
+        return bench_blake2b(rounds);
+    }
+    if(mode == "sha256") {
+        return bench_sha256(rounds);
+    }
+    if(mode == "solver") {
+        return bench_solver(threads, edgebits, std::max(edgebits, max_edgebits), graphs, seed);
+    }
+
+    std::cerr << termcolor::red << "error :: unknown mode: " << mode << termcolor::reset << std::endl;
+    return 1;
+}
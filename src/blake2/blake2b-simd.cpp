@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/crypto/blake2b.h"
+#include "merit/blake2/blake2.h"
+#include "merit/util/cpu.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+// The avx2 code is compiled with a gcc target pragma next to the reference
+// code, like the cuckoo kernels, other compilers only get the reference.
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define MERIT_BLAKE2B_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace merit
+{
+    namespace crypto
+    {
+        namespace
+        {
+            const uint64_t IV[8] = {
+                0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+                0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+            const uint8_t SIGMA[12][16] = {
+                {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+                {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+                {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+                {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+                {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+                {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+                {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+                {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+                {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+                {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+                {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+                {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+            using State = std::array<uint64_t, 8>;
+
+            // compresses one 128 byte block, t bytes in so far, into h
+            using CompressFunc = void (*)(State& h, const unsigned char* block, uint64_t t, bool last);
+
+            // the same for four messages of equal length, one per lane
+            using CompressX4Func = void (*)(State* h, const unsigned char* const* blocks, uint64_t t, bool last);
+
+            void init(State& h, size_t outlen)
+            {
+                std::copy(IV, IV + 8, h.begin());
+                h[0] ^= 0x01010000ULL ^ outlen;
+            }
+
+            void output(unsigned char* out, size_t outlen, const State& h)
+            {
+                std::array<unsigned char, 64> bytes;
+                for(int i = 0; i < 8; i++) {
+                    for(int b = 0; b < 8; b++) {
+                        bytes[i * 8 + b] = static_cast<unsigned char>(h[i] >> (8 * b));
+                    }
+                }
+                std::copy(bytes.begin(), bytes.begin() + outlen, out);
+            }
+        }
+    }
+}
+
+#ifdef MERIT_BLAKE2B_DISPATCH
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace merit
+{
+    namespace crypto
+    {
+        namespace
+        {
+            inline __m256i rotr32(__m256i x)
+            {
+                return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1));
+            }
+
+            inline __m256i rotr24(__m256i x)
+            {
+                const __m256i r24 = _mm256_setr_epi8(
+                        3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+                        3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+                return _mm256_shuffle_epi8(x, r24);
+            }
+
+            inline __m256i rotr16(__m256i x)
+            {
+                const __m256i r16 = _mm256_setr_epi8(
+                        2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                        2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+                return _mm256_shuffle_epi8(x, r16);
+            }
+
+            inline __m256i rotr63(__m256i x)
+            {
+                return _mm256_or_si256(_mm256_srli_epi64(x, 63), _mm256_add_epi64(x, x));
+            }
+
+            inline void g(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i m0, __m256i m1)
+            {
+                a = _mm256_add_epi64(_mm256_add_epi64(a, b), m0);
+                d = rotr32(_mm256_xor_si256(d, a));
+                c = _mm256_add_epi64(c, d);
+                b = rotr24(_mm256_xor_si256(b, c));
+                a = _mm256_add_epi64(_mm256_add_epi64(a, b), m1);
+                d = rotr16(_mm256_xor_si256(d, a));
+                c = _mm256_add_epi64(c, d);
+                b = rotr63(_mm256_xor_si256(b, c));
+            }
+
+            // the rows of the work vector are kept in one register each,
+            // the diagonal step rotates rows b, c and d into columns
+            void compress_avx2(State& h, const unsigned char* block, uint64_t t, bool last)
+            {
+                uint64_t m[16];
+                std::memcpy(m, block, sizeof(m));
+
+                const __m256i h0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&h[0]));
+                const __m256i h1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&h[4]));
+                __m256i a = h0;
+                __m256i b = h1;
+                __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&IV[0]));
+                __m256i d = _mm256_xor_si256(
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&IV[4])),
+                        _mm256_setr_epi64x(t, 0, last ? ~0ULL : 0, 0));
+
+#pragma GCC unroll 12
+                for(int r = 0; r < 12; r++) {
+                    const uint8_t* s = SIGMA[r];
+                    g(a, b, c, d,
+                            _mm256_setr_epi64x(m[s[0]], m[s[2]], m[s[4]], m[s[6]]),
+                            _mm256_setr_epi64x(m[s[1]], m[s[3]], m[s[5]], m[s[7]]));
+                    b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0, 3, 2, 1));
+                    c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+                    d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2, 1, 0, 3));
+                    g(a, b, c, d,
+                            _mm256_setr_epi64x(m[s[8]], m[s[10]], m[s[12]], m[s[14]]),
+                            _mm256_setr_epi64x(m[s[9]], m[s[11]], m[s[13]], m[s[15]]));
+                    b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 1, 0, 3));
+                    c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2));
+                    d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0, 3, 2, 1));
+                }
+
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(&h[0]), _mm256_xor_si256(h0, _mm256_xor_si256(a, c)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(&h[4]), _mm256_xor_si256(h1, _mm256_xor_si256(b, d)));
+            }
+
+            // one message per 64 bit lane, the work vector is sixteen
+            // registers and needs no rotating between the steps
+            void compress_avx2_x4(State* h, const unsigned char* const* blocks, uint64_t t, bool last)
+            {
+                __m256i m[16];
+                for(int i = 0; i < 16; i++) {
+                    uint64_t lane[4];
+                    for(int l = 0; l < 4; l++) {
+                        std::memcpy(&lane[l], blocks[l] + i * 8, 8);
+                    }
+                    m[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lane));
+                }
+
+                __m256i v[16];
+                for(int i = 0; i < 8; i++) {
+                    v[i] = _mm256_setr_epi64x(h[0][i], h[1][i], h[2][i], h[3][i]);
+                    v[i + 8] = _mm256_set1_epi64x(IV[i]);
+                }
+                v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi64x(t));
+                if(last) {
+                    v[14] = _mm256_xor_si256(v[14], _mm256_set1_epi64x(~0ULL));
+                }
+
+#pragma GCC unroll 12
+                for(int r = 0; r < 12; r++) {
+                    const uint8_t* s = SIGMA[r];
+                    g(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+                    g(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+                    g(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+                    g(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+                    g(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+                    g(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+                    g(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+                    g(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+                }
+
+                for(int i = 0; i < 8; i++) {
+                    alignas(32) uint64_t lane[4];
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(lane), _mm256_xor_si256(v[i], v[i + 8]));
+                    for(int l = 0; l < 4; l++) {
+                        h[l][i] ^= lane[l];
+                    }
+                }
+            }
+        }
+    }
+}
+#pragma GCC pop_options
+
+#endif
+
+namespace merit
+{
+    namespace crypto
+    {
+        namespace
+        {
+            CompressFunc compress = nullptr;
+            CompressX4Func compress_x4 = nullptr;
+            Blake2bImpl impl = Blake2bImpl::Ref;
+
+            void select(Blake2bImpl requested)
+            {
+                compress = nullptr;
+                compress_x4 = nullptr;
+                impl = Blake2bImpl::Ref;
+#ifdef MERIT_BLAKE2B_DISPATCH
+                const bool avx2 = util::resolve_isa(util::Isa::Auto) >= util::Isa::AVX2;
+                if(avx2 && (requested == Blake2bImpl::Auto || requested == Blake2bImpl::AVX2)) {
+                    compress = compress_avx2;
+                    compress_x4 = compress_avx2_x4;
+                    impl = Blake2bImpl::AVX2;
+                }
+#endif
+            }
+
+            struct Selected
+            {
+                Selected() { select(Blake2bImpl::Auto); }
+            };
+            const Selected selected;
+
+            // the last block is compressed even when empty, padded with
+            // zeros and flagged
+            size_t blocks(size_t inlen)
+            {
+                return inlen == 0 ? 1 : (inlen + BLAKE2B_BLOCKBYTES - 1) / BLAKE2B_BLOCKBYTES;
+            }
+
+            void last_block(std::array<unsigned char, BLAKE2B_BLOCKBYTES>& block, const unsigned char* in, size_t inlen)
+            {
+                const size_t offset = (blocks(inlen) - 1) * BLAKE2B_BLOCKBYTES;
+                block.fill(0);
+                std::copy(in + offset, in + inlen, block.begin());
+            }
+        }
+
+        const char* to_string(Blake2bImpl i)
+        {
+            switch(i) {
+                case Blake2bImpl::Auto: return "auto";
+                case Blake2bImpl::Ref: return "ref";
+                case Blake2bImpl::AVX2: return "avx2";
+            }
+            return "unknown";
+        }
+
+        void select_blake2b(Blake2bImpl requested)
+        {
+            select(requested);
+        }
+
+        Blake2bImpl blake2b_impl()
+        {
+            return impl;
+        }
+
+        void blake2b(unsigned char* out, size_t outlen, const unsigned char* in, size_t inlen)
+        {
+            assert(outlen > 0 && outlen <= BLAKE2B_OUTBYTES);
+            if(!compress) {
+                ::blake2b(out, outlen, in, inlen, nullptr, 0);
+                return;
+            }
+
+            State h;
+            init(h, outlen);
+
+            const size_t n = blocks(inlen);
+            for(size_t i = 0; i + 1 < n; i++) {
+                compress(h, in + i * BLAKE2B_BLOCKBYTES, (i + 1) * BLAKE2B_BLOCKBYTES, false);
+            }
+
+            std::array<unsigned char, BLAKE2B_BLOCKBYTES> block;
+            last_block(block, in, inlen);
+            compress(h, block.data(), inlen, true);
+            output(out, outlen, h);
+        }
+
+        void blake2b_batch(
+                unsigned char* out,
+                size_t outlen,
+                const unsigned char* const* in,
+                size_t inlen,
+                size_t n)
+        {
+            assert(outlen > 0 && outlen <= BLAKE2B_OUTBYTES);
+            if(!compress_x4) {
+                for(size_t i = 0; i < n; i++) {
+                    blake2b(out + i * outlen, outlen, in[i], inlen);
+                }
+                return;
+            }
+
+            const size_t count = blocks(inlen);
+            for(size_t i = 0; i < n; i += 4) {
+                // lanes past the end hash the last message again
+                const size_t lanes = std::min<size_t>(4, n - i);
+                std::array<const unsigned char*, 4> msgs;
+                for(size_t l = 0; l < 4; l++) {
+                    msgs[l] = in[i + std::min(l, lanes - 1)];
+                }
+
+                std::array<State, 4> h;
+                for(auto& s : h) {
+                    init(s, outlen);
+                }
+
+                std::array<const unsigned char*, 4> ptrs;
+                for(size_t b = 0; b + 1 < count; b++) {
+                    for(size_t l = 0; l < 4; l++) {
+                        ptrs[l] = msgs[l] + b * BLAKE2B_BLOCKBYTES;
+                    }
+                    compress_x4(h.data(), ptrs.data(), (b + 1) * BLAKE2B_BLOCKBYTES, false);
+                }
+
+                std::array<std::array<unsigned char, BLAKE2B_BLOCKBYTES>, 4> last;
+                for(size_t l = 0; l < 4; l++) {
+                    last_block(last[l], msgs[l], inlen);
+                    ptrs[l] = last[l].data();
+                }
+                compress_x4(h.data(), ptrs.data(), inlen, true);
+
+                for(size_t l = 0; l < lanes; l++) {
+                    output(out + (i + l) * outlen, outlen, h[l]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "solver.h"
+
+#include <cassert>
+#include <set>
+#include <unordered_map>
+
+namespace merit
+{
+    namespace cuckoo
+    {
+        namespace
+        {
+            using Forest = std::unordered_map<std::uint32_t, std::uint32_t>;
+
+            std::uint32_t path(const Forest& cuckoo, std::uint32_t u, std::uint32_t* us)
+            {
+                std::uint32_t nu = 0;
+                while (true) {
+                    if (nu >= MAXPATHLEN) {
+                        while (nu-- && us[nu] != u)
+                            ;
+                        break;
+                    }
+                    us[nu++] = u;
+                    const auto it = cuckoo.find(u);
+                    if (it == cuckoo.end()) {
+                        break;
+                    }
+                    u = it->second;
+                }
+                return nu - 1;
+            }
+
+            // maps the node pairs of a cycle back to edge indices. cycles
+            // are rare and the surviving edges few so a scan is fine.
+            EdgeIndices solution(
+                    const std::vector<std::uint32_t>& unodes,
+                    const std::vector<std::uint32_t>& vnodes,
+                    const std::uint32_t* us, std::uint32_t nu,
+                    const std::uint32_t* vs, std::uint32_t nv)
+            {
+                std::set<std::uint64_t> pairs;
+                auto record = [&pairs](const std::uint32_t u, const std::uint32_t v) {
+                    pairs.insert(std::uint64_t{u} << 32 | v);
+                };
+
+                record(*us, *vs);
+                while (nu--)
+                    record(us[(nu + 1) & ~1], us[nu | 1]); // u's in even position; v's in odd
+                while (nv--)
+                    record(vs[nv | 1], vs[(nv + 1) & ~1]); // u's in odd position; v's in even
+
+                EdgeIndices indices;
+                for (std::uint32_t i = 0; i < unodes.size() && !pairs.empty(); i++) {
+                    auto it = pairs.find(std::uint64_t{unodes[i]} << 32 | vnodes[i]);
+                    if (it != pairs.end()) {
+                        indices.push_back(i);
+                        pairs.erase(it);
+                    }
+                }
+                return indices;
+            }
+        }
+
+        std::vector<EdgeIndices> find_cycle_indices(
+                const std::vector<std::uint32_t>& unodes,
+                const std::vector<std::uint32_t>& vnodes,
+                const std::uint8_t proofSize)
+        {
+            assert(unodes.size() == vnodes.size());
+
+            Forest cuckoo;
+            cuckoo.reserve(2 * unodes.size());
+
+            std::vector<std::uint32_t> usbuf(MAXPATHLEN), vsbuf(MAXPATHLEN);
+            std::uint32_t* us = usbuf.data();
+            std::uint32_t* vs = vsbuf.data();
+
+            std::vector<EdgeIndices> cycles;
+            for (size_t i = 0; i < unodes.size(); i++) {
+                const std::uint32_t u0 = unodes[i], v0 = vnodes[i];
+                std::uint32_t nu = path(cuckoo, u0, us);
+                std::uint32_t nv = path(cuckoo, v0, vs);
+                if (us[nu] == vs[nv]) {
+                    const std::uint32_t min = nu < nv ? nu : nv;
+                    for (nu -= min, nv -= min; us[nu] != vs[nv]; nu++, nv++)
+                        ;
+                    const std::uint32_t len = nu + nv + 1;
+                    if (len == proofSize) {
+                        auto indices = solution(unodes, vnodes, us, nu, vs, nv);
+                        if (indices.size() == proofSize) {
+                            cycles.push_back(indices);
+                        }
+                    }
+                } else if (nu < nv) {
+                    while (nu--)
+                        cuckoo[us[nu + 1]] = us[nu];
+                    cuckoo[u0] = v0;
+                } else {
+                    while (nv--)
+                        cuckoo[vs[nv + 1]] = vs[nv];
+                    cuckoo[v0] = u0;
+                }
+            }
+
+            return cycles;
+        }
+    }
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "solver.h"
+
+#include "merit/crypto/siphash.h"
+#include "merit/util/barrier.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <future>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// The lean solver keeps one alive bit per edge and, for the side being
+// trimmed, two bits per node: seen once and seen twice. A trimming round
+// hashes every alive edge to its node and sets the bits, then kills the
+// edges whose node was only seen once. The graph is 3/8 of a byte per edge
+// instead of the several bytes the mean solver's bucket matrix needs, at the
+// cost of hashing each alive edge twice per side.
+
+namespace merit
+{
+    namespace cuckoo
+    {
+        namespace
+        {
+            using word_t = std::uint64_t;
+            const std::uint32_t WORDBITS = 64;
+
+            class lean_ctx : public solver_base
+            {
+                public:
+                    lean_ctx(
+                            std::uint8_t edgeBits,
+                            std::uint8_t proofSizeIn,
+                            size_t threadsIn,
+                            ctpl::thread_pool& poolIn,
+                            const SolverOptions& options) :
+                        nedges{std::uint64_t{1} << edgeBits},
+                        edgemask{static_cast<std::uint32_t>(nedges - 1)},
+                        nwords{nedges / WORDBITS},
+                        nTrims{edgeBits >= 30 ? 96u : 68u},
+                        proofSize{proofSizeIn},
+                        threads{static_cast<std::uint32_t>(threadsIn)},
+                        pool{poolIn},
+                        cpus{options.cpus},
+                        barry{threadsIn, options.barrier_spin},
+                        killed(threadsIn, 0)
+                    {
+                        assert(threads > 0);
+
+                        pages = util::allocate_pages(lean_bytes(edgeBits), options.pages, options.numa_node);
+                        alive = reinterpret_cast<word_t*>(pages.data);
+                        seen = reinterpret_cast<std::atomic<word_t>*>(alive + nwords);
+                        twice = seen + nwords;
+                    }
+
+                    ~lean_ctx()
+                    {
+                        util::free_pages(pages);
+                    }
+
+                    bool find_cycles(
+                            const crypto::siphash_keys& keys,
+                            Cycles& cycles,
+                            const util::CancelToken& cancel) override
+                    {
+                        sip_keys = keys;
+                        trim(cancel);
+                        if (stale) {
+                            return false;
+                        }
+                        return findcycles(cycles);
+                    }
+
+                    util::PageBacking page_backing() const override
+                    {
+                        return pages.backing;
+                    }
+
+                    std::uint32_t trim_rounds() const override
+                    {
+                        return rounds;
+                    }
+
+                    bool aborted() const override
+                    {
+                        return stale;
+                    }
+
+                private:
+                    std::uint32_t node(const std::uint64_t edge, const std::uint32_t uorv) const
+                    {
+                        return crypto::_sipnode(&sip_keys, edgemask, edge, uorv);
+                    }
+
+                    void trim(const util::CancelToken& cancelIn)
+                    {
+                        std::fill(killed.begin(), killed.end(), 0);
+                        rounds = 2 * nTrims;
+                        cancel = &cancelIn;
+                        stale = false;
+
+                        if (threads == 1) {
+                            trimmer(0);
+                            return;
+                        }
+
+                        std::vector<std::future<void>> jobs;
+                        for (std::uint32_t t = 0; t < threads; t++) {
+                            jobs.push_back(
+                                    pool.push([this, t](int id) {
+                                        util::ScopedPin pinned{cpus};
+                                        trimmer(t);
+                                        }));
+                        }
+
+                        for (auto& j : jobs) {
+                            j.wait();
+                        }
+                    }
+
+                    void trimmer(const std::uint32_t id)
+                    {
+                        const std::uint64_t start = nwords * id / threads;
+                        const std::uint64_t end = nwords * (id + 1) / threads;
+
+                        std::fill(alive + start, alive + end, ~word_t{0});
+
+                        std::uint64_t before = 0;
+                        for (std::uint32_t round = 0; round < nTrims; round++) {
+                            for (std::uint32_t uorv = 0; uorv < 2; uorv++) {
+                                for (std::uint64_t w = start; w < end; w++) {
+                                    seen[w].store(0, std::memory_order_relaxed);
+                                    twice[w].store(0, std::memory_order_relaxed);
+                                }
+
+                                // the last thread in decides for all of them
+                                barry.wait([this, round, uorv] {
+                                        stale = cancel->cancelled();
+                                        if (stale) {
+                                            rounds = 2 * round + uorv;
+                                        }
+                                        });
+                                if (stale) {
+                                    return;
+                                }
+                                mark(start, end, uorv);
+                                barry.wait();
+                                killed[id] += kill(start, end, uorv);
+
+                                // the other side reuses seen and twice, which
+                                // kill may still be reading on other threads
+                                barry.wait();
+                            }
+
+                            // stop once a whole round kills nothing, every
+                            // thread sees the same totals so they stop together
+                            std::uint64_t total = 0;
+                            for (const auto k : killed) {
+                                total += k;
+                            }
+                            if (total == before) {
+                                if (id == 0) {
+                                    rounds = 2 * (round + 1);
+                                }
+                                break;
+                            }
+                            before = total;
+                        }
+                    }
+
+                    void mark(const std::uint64_t start, const std::uint64_t end, const std::uint32_t uorv)
+                    {
+                        for (std::uint64_t w = start; w < end; w++) {
+                            for (word_t a = alive[w]; a; a &= a - 1) {
+                                const std::uint32_t u = node(w * WORDBITS + __builtin_ctzll(a), uorv);
+                                const word_t bit = word_t{1} << (u % WORDBITS);
+                                std::atomic<word_t>& s = seen[u / WORDBITS];
+                                if ((s.load(std::memory_order_relaxed) & bit) || (s.fetch_or(bit, std::memory_order_relaxed) & bit)) {
+                                    std::atomic<word_t>& t = twice[u / WORDBITS];
+                                    if (!(t.load(std::memory_order_relaxed) & bit)) {
+                                        t.fetch_or(bit, std::memory_order_relaxed);
+                                    }
+                                }
+                            }
+                        }
+                    }
+
+                    std::uint64_t kill(const std::uint64_t start, const std::uint64_t end, const std::uint32_t uorv)
+                    {
+                        std::uint64_t n = 0;
+                        for (std::uint64_t w = start; w < end; w++) {
+                            word_t keep = alive[w];
+                            for (word_t a = alive[w]; a; a &= a - 1) {
+                                const std::uint32_t bitpos = __builtin_ctzll(a);
+                                const std::uint32_t u = node(w * WORDBITS + bitpos, uorv);
+                                if (!(twice[u / WORDBITS].load(std::memory_order_relaxed) & (word_t{1} << (u % WORDBITS)))) {
+                                    keep &= ~(word_t{1} << bitpos);
+                                    n++;
+                                }
+                            }
+                            alive[w] = keep;
+                        }
+                        return n;
+                    }
+
+                    bool findcycles(Cycles& cycles)
+                    {
+                        edges.clear();
+                        unodes.clear();
+                        vnodes.clear();
+                        for (std::uint64_t w = 0; w < nwords; w++) {
+                            for (word_t a = alive[w]; a; a &= a - 1) {
+                                const std::uint32_t e = w * WORDBITS + __builtin_ctzll(a);
+                                edges.push_back(e);
+                                unodes.push_back(node(e, 0) << 1);
+                                vnodes.push_back(node(e, 1) << 1 | 1);
+                            }
+                        }
+
+                        const auto found = find_cycle_indices(unodes, vnodes, proofSize);
+                        for (const auto& indices : found) {
+                            Cycle cycle;
+                            for (auto i : indices) {
+                                cycle.insert(edges[i]);
+                            }
+                            cycles.emplace_back(cycle);
+                        }
+                        return !found.empty();
+                    }
+
+                private:
+                    const std::uint64_t nedges;
+                    const std::uint32_t edgemask;
+                    const std::uint64_t nwords;
+                    const std::uint32_t nTrims;
+                    const std::uint8_t proofSize;
+                    const std::uint32_t threads;
+                    ctpl::thread_pool& pool;
+                    util::CpuSet cpus;
+                    util::SpinBarrier barry;
+
+                    crypto::siphash_keys sip_keys;
+                    util::Pages pages;
+                    word_t* alive;
+                    std::atomic<word_t>* seen;
+                    std::atomic<word_t>* twice;
+                    std::vector<std::uint64_t> killed;
+                    std::uint32_t rounds;
+                    const util::CancelToken* cancel;
+                    bool stale = false;
+
+                    std::vector<std::uint32_t> edges;
+                    std::vector<std::uint32_t> unodes;
+                    std::vector<std::uint32_t> vnodes;
+            };
+        }
+
+        std::uint64_t lean_bytes(std::uint8_t edgeBits)
+        {
+            // alive bits per edge plus seen and twice bits per node
+            return 3 * (std::uint64_t{1} << edgeBits) / 8;
+        }
+
+        std::unique_ptr<solver_base> make_lean_solver(
+                std::uint8_t edgeBits,
+                std::uint8_t proofSize,
+                size_t threads,
+                ctpl::thread_pool& pool,
+                const SolverOptions& options)
+        {
+            if (edgeBits < MIN_EDGE_BITS || edgeBits > MAX_EDGE_BITS) {
+                std::stringstream s;
+                s << __func__ << ": EDGEBITS equal to " << static_cast<int>(edgeBits) << " is not supported";
+                throw std::runtime_error{s.str()};
+            }
+
+            return std::unique_ptr<solver_base>{new lean_ctx{edgeBits, proofSize, threads, pool, options}};
+        }
+    }
+}
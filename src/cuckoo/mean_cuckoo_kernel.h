@@ -0,0 +1,1979 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+
+// Solver kernels, included once per simd level by mean_cuckoo.cpp with
+// MERIT_CUCKOO_ISA naming the namespace and NSIPHASH the number of siphash
+// lanes. Deliberately has no include guard.
+
+#ifndef MERIT_CUCKOO_ISA
+#error MERIT_CUCKOO_ISA must be defined
+#endif
+
+#ifndef NSIPHASH
+#error NSIPHASH must be defined
+#endif
+
+namespace merit
+{
+    namespace cuckoo
+    {
+        namespace MERIT_CUCKOO_ISA
+        {
+            // break circular reference with forward declaration
+
+            template <typename offset_t, std::uint8_t EDGEBITS, std::uint8_t XBITS>
+                class edgetrimmer;
+
+            template <typename offset_t, std::uint8_t EDGEBITS, std::uint8_t XBITS>
+                class solver_ctx;
+
+            template <typename offset_t, std::uint8_t EDGEBITS, std::uint8_t XBITS>
+                void etworker(edgetrimmer<offset_t, EDGEBITS, XBITS>* et, std::uint32_t id)
+                {
+                    et->trimmer(id);
+                }
+
+            template <typename offset_t, std::uint8_t EDGEBITS, std::uint8_t XBITS>
+                void matchworker(solver_ctx<offset_t, EDGEBITS, XBITS>* solver, std::uint32_t id)
+                {
+                    solver->matchUnodes(solver->match, id, solver->threads);
+                }
+
+            template <typename offset_t, std::uint8_t EDGEBITS, std::uint8_t XBITS>
+                void findworker(solver_ctx<offset_t, EDGEBITS, XBITS>* solver, std::uint32_t id)
+                {
+                    solver->findcycles(id);
+                }
+
+            // maintains set of trimmable edges
+            template <typename offset_t, std::uint8_t EDGEBITS, std::uint8_t XBITS>
+                class edgetrimmer
+                {
+                    public:
+                        using P = Params<EDGEBITS, XBITS>;
+                        using zbucket8P = std::uint8_t[2 * cmax(Params<EDGEBITS, XBITS>::NZ, Params<EDGEBITS, XBITS>::NYZ1)];
+                        using zbucket16P = zbucket16<EDGEBITS, XBITS>;
+                        using zbucket32P = zbucket32<EDGEBITS, XBITS>;
+                        using zbucketZ = zbucket<EDGEBITS, XBITS, P::ZBUCKETSIZE>;
+                        using yzbucketZ = yzbucket<EDGEBITS, XBITS, P::ZBUCKETSIZE>;
+                        using yzbucketT = yzbucket<EDGEBITS, XBITS, P::TBUCKETSIZE>;
+                        using indexerZ = indexer<offset_t, EDGEBITS, XBITS, P::ZBUCKETSIZE>;
+                        using indexerT = indexer<offset_t, EDGEBITS, XBITS, P::TBUCKETSIZE>;
+
+                        crypto::siphash_keys sip_keys;
+                        util::Pages bucketpages;
+                        util::Pages tbucketpages;
+                        yzbucketZ* buckets;
+                        yzbucketT* tbuckets;
+                        zbucket32P* tedges;
+                        zbucket16P* tzs;
+                        zbucket8P* tdegs;
+                        offset_t* tcounts;
+                        std::uint8_t threads;
+                        ctpl::thread_pool& pool;
+                        std::uint32_t nTrims;
+                        util::SpinBarrier* barry;
+                        util::CpuSet cpus;
+
+                        // adaptive round count, see trimmed_enough
+                        double stopRate;
+                        offset_t lastcount;
+                        bool trimmed;
+                        std::uint32_t rounds;
+
+                        // the attempt's token, checked before every round pair.
+                        // stale once it was cancelled and the graph given up.
+                        const util::CancelToken* cancel;
+                        bool stale;
+
+                        // software write combining for the bucket scatters, a
+                        // staged line per destination bucket and thread
+                        struct alignas(64) wcline
+                        {
+                            std::uint8_t bytes[72];  // the line and the spill of a slot crossing its end
+                            std::uint8_t* line;      // destination line
+                            std::uint32_t lo;        // first byte of the line in the bucket
+                        };
+
+                        static_assert(sizeof(wcline) == 128, "staged lines are indexed by shifting");
+
+                        util::Pages wcpages;
+                        wcline* wclines;
+
+                        // per round timing, see GraphTelemetry
+                        bool telemetry;
+                        GraphTelemetry stages;
+                        std::chrono::steady_clock::time_point stagestart;
+
+                        using BIGTYPE0 = offset_t;
+
+                        void touch(std::uint8_t* p, const offset_t n)
+                        {
+                            for (offset_t i = 0; i < n; i += 4096)
+                                *(std::uint32_t*)(p + i) = 0;
+                        }
+
+                        edgetrimmer(
+                                ctpl::thread_pool& poolIn,
+                                size_t threadsIn,
+                                const std::uint32_t nTrimsIn,
+                                const SolverOptions& options) : pool{poolIn}, nTrims{nTrimsIn}, cpus{options.cpus}, stopRate{options.trim_stop_rate}, rounds{nTrimsIn}, cancel{nullptr}, stale{false}, telemetry{options.telemetry}
+                        {                    
+
+                            threads = threadsIn;
+
+                            // first touch happens on the calling worker thread which
+                            // is pinned to the same node when NUMA placement is on
+                            bucketpages = util::allocate_pages(sizeof(yzbucketZ) * P::NX, options.pages, options.numa_node);
+                            buckets = reinterpret_cast<yzbucketZ*>(bucketpages.data);
+                            touch((std::uint8_t*)buckets, sizeof(zbucket<EDGEBITS, XBITS, P::ZBUCKETSIZE>) * P::NX * P::NY);
+                            tbucketpages = util::allocate_pages(sizeof(yzbucketT) * threads, options.pages, options.numa_node);
+                            tbuckets = reinterpret_cast<yzbucketT*>(tbucketpages.data);
+                            touch((std::uint8_t*)tbuckets, threads * sizeof(yzbucketT));
+
+                            tedges = new zbucket32P[threads];
+                            tdegs = new zbucket8P[threads];
+                            tzs = new zbucket16P[threads];
+                            tcounts = new offset_t[threads];
+
+                            barry = new util::SpinBarrier(threads, options.barrier_spin);
+
+                            wclines = nullptr;
+                            if (options.streaming_stores) {
+                                wcpages = util::allocate_pages(sizeof(wcline) * P::NX * threads, util::PageBacking::Normal, options.numa_node);
+                                wclines = reinterpret_cast<wcline*>(wcpages.data);
+                            }
+                        }
+                        ~edgetrimmer()
+                        {
+                            util::free_pages(bucketpages);
+                            util::free_pages(tbucketpages);
+                            if (wclines) {
+                                util::free_pages(wcpages);
+                            }
+                            delete[] tedges;
+                            delete[] tdegs;
+                            delete[] tzs;
+                            delete[] tcounts;
+                            delete barry;
+                        }
+                        util::PageBacking backing() const
+                        {
+                            return std::min(bucketpages.backing, tbucketpages.backing);
+                        }
+
+                        offset_t count() const
+                        {
+                            offset_t cnt = 0;
+                            for (std::uint32_t t = 0; t < threads; t++)
+                                cnt += tcounts[t];
+                            return cnt;
+                        }
+
+                        // closes a stage, run by the last thread to reach its
+                        // barrier so the counts are complete and not yet reused
+                        void mark()
+                        {
+                            const auto now = std::chrono::steady_clock::now();
+                            stages.round_time.push_back(now - stagestart);
+                            stages.round_edges.push_back(count());
+                            stagestart = now;
+                        }
+
+                        void endstage()
+                        {
+                            if (telemetry) {
+                                barry->wait([this] { mark(); });
+                            } else {
+                                barry->wait();
+                            }
+                        }
+
+                        // run by the last thread to finish a round pair once the
+                        // edges are renamed. true when the pair removed less than
+                        // stopRate of the edges and every row and column is small
+                        // enough for its renamed nodes to fit the cuckoo table.
+                        bool trimmed_enough()
+                        {
+                            const offset_t remaining = count();
+                            const bool first = lastcount == 0;
+                            const bool slow = lastcount - remaining < stopRate * lastcount;
+                            lastcount = remaining;
+                            if (first || !slow) {
+                                return false;
+                            }
+
+                            for (std::uint32_t x = 0; x < P::NX; x++) {
+                                std::uint32_t row = 0, column = 0;
+                                for (std::uint32_t y = 0; y < P::NY; y++) {
+                                    row += buckets[x][y].size;
+                                    column += buckets[y][x].size;
+                                }
+                                if (row > P::NYZ2 * sizeof(std::uint32_t) || column > P::NYZ2 * sizeof(std::uint32_t)) {
+                                    return false;
+                                }
+                            }
+                            return true;
+                        }
+
+                        // staged lines of a thread, null when stores go straight
+                        // to the buckets
+                        wcline* combiner(const std::uint32_t id) const
+                        {
+                            return wclines ? wclines + id * P::NX : nullptr;
+                        }
+
+                        static void streamline(std::uint8_t* dst, const std::uint8_t* src)
+                        {
+#if NSIPHASH == 16
+                            _mm512_stream_si512((__m512i*)dst, _mm512_load_si512((const __m512i*)src));
+#elif NSIPHASH == 8
+                            _mm256_stream_si256((__m256i*)dst, _mm256_load_si256((const __m256i*)src));
+                            _mm256_stream_si256((__m256i*)(dst + 32), _mm256_load_si256((const __m256i*)(src + 32)));
+#elif defined(__x86_64__) || defined(__i386__)
+                            for (std::uint32_t i = 0; i < 64; i += 16)
+                                _mm_stream_si128((__m128i*)(dst + i), _mm_load_si128((const __m128i*)(src + i)));
+#else
+                            std::memcpy(dst, src, 64);
+#endif
+                        }
+
+                        // stores value at base + index and moves index on by size,
+                        // which is zero for a slot that gets dropped. with write
+                        // combining the bytes are staged and every completed line
+                        // is streamed out, so buckets that are only read back next
+                        // round don't evict the working set from the cache.
+                        template <typename T>
+                            static void scatter(
+                                    std::uint8_t const* base,
+                                    offset_t& index,
+                                    wcline* wc,
+                                    const std::uint32_t x,
+                                    const T value,
+                                    const std::uint32_t size)
+                            {
+                                if (!wc) {
+                                    *(T*)(base + index) = value;
+                                    index += size;
+                                    return;
+                                }
+
+                                // base is page aligned so the index gives the line offset
+                                const std::uint32_t off = index & 63;
+                                wcline& w = wc[x];
+                                memcpy(w.bytes + off, &value, sizeof(T));
+                                index += size;
+
+                                if (off + size >= 64) {
+                                    // the first line of a bucket is shared with
+                                    // whatever precedes it, so only whole lines stream
+                                    if (w.lo == 0) {
+                                        streamline(w.line, w.bytes);
+                                    } else {
+                                        memcpy(w.line + w.lo, w.bytes + w.lo, 64 - w.lo);
+                                    }
+                                    memcpy(w.bytes, w.bytes + 64, sizeof(std::uint64_t));
+                                    w.line += 64;
+                                    w.lo = 0;
+                                }
+                            }
+
+                        // points the staged lines at the lines dst's buckets start in
+                        static void stage(std::uint8_t const* base, const indexerZ& dst, wcline* wc)
+                        {
+                            if (!wc) {
+                                return;
+                            }
+                            for (std::uint32_t x = 0; x < P::NX; x++) {
+                                wc[x].line = (std::uint8_t*)base + (dst.index[x] & ~(offset_t)63);
+                                wc[x].lo = dst.index[x] & 63;
+                            }
+                        }
+
+                        // writes the partial lines still staged for dst's buckets
+                        static void unstage(std::uint8_t const* base, const indexerZ& dst, wcline* wc)
+                        {
+                            if (!wc) {
+                                return;
+                            }
+                            for (std::uint32_t x = 0; x < P::NX; x++) {
+                                const wcline& w = wc[x];
+                                const std::uint32_t end = (base + dst.index[x]) - w.line;
+                                if (end > w.lo) {
+                                    memcpy(w.line + w.lo, w.bytes + w.lo, end - w.lo);
+                                }
+                            }
+                        }
+
+                        // streamed lines must be visible before the round barrier
+                        static void fence(const wcline* wc)
+                        {
+                            if (wc) {
+#if defined(__x86_64__) || defined(__i386__)
+                                _mm_sfence();
+#else
+                                std::atomic_thread_fence(std::memory_order_release);
+#endif
+                            }
+                        }
+
+#if NSIPHASH == 8
+
+                        template <int x, int i>
+                            void store(
+                                    std::uint8_t const* base,
+                                    std::uint32_t& ux,
+                                    indexerZ& dst,
+                                    wcline* wc,
+                                    std::uint32_t last[],
+                                    const std::uint32_t edge,
+                                    __m256i v,
+                                    __m256i w)
+                            {
+                                if (!P::NEEDSYNC) {
+                                    ux = _mm256_extract_epi32(v, x);
+                                    scatter<std::uint64_t>(base, dst.index[ux], wc, ux, _mm256_extract_epi64(w, i % 4), P::BIGSIZE0);
+                                } else {
+                                    std::uint32_t zz = _mm256_extract_epi32(w, x);
+
+                                    if (i || likely(zz)) {
+                                        ux = _mm256_extract_epi32(v, x);
+                                        for (; unlikely(last[ux] + P::NNONYZ <= edge + i); last[ux] += P::NNONYZ)
+                                            scatter<std::uint32_t>(base, dst.index[ux], wc, ux, 0, P::BIGSIZE0);
+                                        scatter<std::uint32_t>(base, dst.index[ux], wc, ux, zz, P::BIGSIZE0);
+                                        last[ux] = edge + i;
+                                    }
+                                }
+                            }
+#elif NSIPHASH == 16
+
+                        void store(
+                                std::uint8_t const* base,
+                                indexerZ& dst,
+                                wcline* wc,
+                                std::uint32_t last[],
+                                const std::uint32_t edge,
+                                const std::uint32_t i,
+                                const std::uint32_t ux,
+                                const std::uint64_t w)
+                        {
+                            if (!P::NEEDSYNC) {
+                                scatter<std::uint64_t>(base, dst.index[ux], wc, ux, w, P::BIGSIZE0);
+                            } else {
+                                const std::uint32_t zz = w;
+
+                                if (i || likely(zz)) {
+                                    for (; unlikely(last[ux] + P::NNONYZ <= edge + i); last[ux] += P::NNONYZ)
+                                        scatter<std::uint32_t>(base, dst.index[ux], wc, ux, 0, P::BIGSIZE0);
+                                    scatter<std::uint32_t>(base, dst.index[ux], wc, ux, zz, P::BIGSIZE0);
+                                    last[ux] = edge + i;
+                                }
+                            }
+                        }
+#endif
+
+                        void genUnodes(const std::uint32_t id, const std::uint32_t uorv)
+                        {
+                            std::uint32_t last[P::NX];
+
+                            std::uint8_t const* base = (std::uint8_t*)buckets;
+                            indexerZ dst;
+                            wcline* wc = combiner(id);
+                            const std::uint32_t starty = P::NY * id / threads;
+                            const std::uint32_t endy = P::NY * (id + 1) / threads;
+
+                            std::uint32_t edge = starty << P::YZBITS;
+                            std::uint32_t endedge = edge + P::NYZ;
+
+#if NSIPHASH == 8
+                            static const __m256i vxmask = {P::XMASK, P::XMASK, P::XMASK, P::XMASK};
+                            static const __m256i vyzmask = {P::YZMASK, P::YZMASK, P::YZMASK, P::YZMASK};
+                            const __m256i vinit = _mm256_set_epi64x(
+                                    sip_keys.k1 ^ 0x7465646279746573ULL,
+                                    sip_keys.k0 ^ 0x6c7967656e657261ULL,
+                                    sip_keys.k1 ^ 0x646f72616e646f6dULL,
+                                    sip_keys.k0 ^ 0x736f6d6570736575ULL);
+                            __m256i v0, v1, v2, v3, v4, v5, v6, v7;
+                            const std::uint32_t e2 = 2 * edge + uorv;
+                            __m256i vpacket0 = _mm256_set_epi64x(e2 + 6, e2 + 4, e2 + 2, e2 + 0);
+                            __m256i vpacket1 = _mm256_set_epi64x(e2 + 14, e2 + 12, e2 + 10, e2 + 8);
+                            static const __m256i vpacketinc = {16, 16, 16, 16};
+                            std::uint64_t e1 = edge;
+                            __m256i vhi0 = _mm256_set_epi64x((e1 + 3) << P::YZBITS, (e1 + 2) << P::YZBITS, (e1 + 1) << P::YZBITS, (e1 + 0) << P::YZBITS);
+                            __m256i vhi1 = _mm256_set_epi64x((e1 + 7) << P::YZBITS, (e1 + 6) << P::YZBITS, (e1 + 5) << P::YZBITS, (e1 + 4) << P::YZBITS);
+                            static const __m256i vhiinc = {8 << P::YZBITS, 8 << P::YZBITS, 8 << P::YZBITS, 8 << P::YZBITS};
+#elif NSIPHASH == 16
+                            const __m512i vxmask = _mm512_set1_epi64(P::XMASK);
+                            const __m512i vyzmask = _mm512_set1_epi64(P::YZMASK);
+                            const __m512i vinit0 = _mm512_set1_epi64(sip_keys.k0 ^ 0x736f6d6570736575ULL);
+                            const __m512i vinit1 = _mm512_set1_epi64(sip_keys.k1 ^ 0x646f72616e646f6dULL);
+                            const __m512i vinit2 = _mm512_set1_epi64(sip_keys.k0 ^ 0x6c7967656e657261ULL);
+                            const __m512i vinit3 = _mm512_set1_epi64(sip_keys.k1 ^ 0x7465646279746573ULL);
+                            const __m512i vff = _mm512_set1_epi64(0xff);
+                            __m512i v0, v1, v2, v3, v4, v5, v6, v7;
+                            const std::uint64_t e2 = 2 * edge + uorv;
+                            __m512i vpacket0 = _mm512_set_epi64(e2 + 14, e2 + 12, e2 + 10, e2 + 8, e2 + 6, e2 + 4, e2 + 2, e2 + 0);
+                            __m512i vpacket1 = _mm512_set_epi64(e2 + 30, e2 + 28, e2 + 26, e2 + 24, e2 + 22, e2 + 20, e2 + 18, e2 + 16);
+                            const __m512i vpacketinc = _mm512_set1_epi64(32);
+                            const __m512i vhiinit = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+                            std::uint64_t e1 = edge;
+                            __m512i vhi0 = _mm512_slli_epi64(_mm512_add_epi64(vhiinit, _mm512_set1_epi64(e1)), P::YZBITS);
+                            __m512i vhi1 = _mm512_slli_epi64(_mm512_add_epi64(vhiinit, _mm512_set1_epi64(e1 + 8)), P::YZBITS);
+                            const __m512i vhiinc = _mm512_set1_epi64(16ULL << P::YZBITS);
+                            alignas(64) std::uint64_t uxs[NSIPHASH];
+                            alignas(64) std::uint64_t zzs[NSIPHASH];
+#endif
+
+                            offset_t sumsize = 0;
+                            for (std::uint32_t my = starty; my < endy; my++, endedge += P::NYZ) {
+                                dst.matrixv(my);
+                                stage(base, dst, wc);
+
+                                if (P::NEEDSYNC) {
+                                    for (std::uint32_t x = 0; x < P::NX; x++) {
+                                        last[x] = edge;
+                                    }
+                                }
+                                // edge is a "nonce" for sipnode()
+                                for (; edge < endedge; edge += NSIPHASH) {
+                                    // bit        28..21     20..13    12..0
+                                    // node       XXXXXX     YYYYYY    ZZZZZ
+
+#if NSIPHASH == 1
+                                    const std::uint32_t node = _sipnode(&sip_keys, P::EDGEMASK, edge, uorv);
+                                    const std::uint32_t ux = node >> P::YZBITS;
+                                    const BIGTYPE0 zz = (BIGTYPE0)edge << P::YZBITS | (node & P::YZMASK);
+
+                                    if (!P::NEEDSYNC) {
+                                        // bit        39..21     20..13    12..0
+                                        // write        edge     YYYYYY    ZZZZZ
+                                        scatter<BIGTYPE0>(base, dst.index[ux], wc, ux, zz, P::BIGSIZE0);
+                                    } else {
+                                        if (zz) {
+                                            for (; unlikely(last[ux] + P::NNONYZ <= edge); last[ux] += P::NNONYZ)
+                                                scatter<std::uint32_t>(base, dst.index[ux], wc, ux, 0, P::BIGSIZE0);
+                                            scatter<std::uint32_t>(base, dst.index[ux], wc, ux, zz, P::BIGSIZE0);
+                                            last[ux] = edge;
+                                        }
+                                    }
+#elif NSIPHASH == 8
+                                    v3 = _mm256_permute4x64_epi64(vinit, 0xFF);
+                                    v0 = _mm256_permute4x64_epi64(vinit, 0x00);
+                                    v1 = _mm256_permute4x64_epi64(vinit, 0x55);
+                                    v2 = _mm256_permute4x64_epi64(vinit, 0xAA);
+                                    v7 = _mm256_permute4x64_epi64(vinit, 0xFF);
+                                    v4 = _mm256_permute4x64_epi64(vinit, 0x00);
+                                    v5 = _mm256_permute4x64_epi64(vinit, 0x55);
+                                    v6 = _mm256_permute4x64_epi64(vinit, 0xAA);
+
+                                    v3 = XOR(v3, vpacket0);
+                                    v7 = XOR(v7, vpacket1);
+                                    SIPROUNDX8;
+                                    SIPROUNDX8;
+                                    v0 = XOR(v0, vpacket0);
+                                    v4 = XOR(v4, vpacket1);
+                                    v2 = XOR(v2, _mm256_broadcastq_epi64(_mm_cvtsi64_si128(0xff)));
+                                    v6 = XOR(v6, _mm256_broadcastq_epi64(_mm_cvtsi64_si128(0xff)));
+                                    SIPROUNDX8;
+                                    SIPROUNDX8;
+                                    SIPROUNDX8;
+                                    SIPROUNDX8;
+                                    v0 = XOR(XOR(v0, v1), XOR(v2, v3));
+                                    v4 = XOR(XOR(v4, v5), XOR(v6, v7));
+
+                                    vpacket0 = _mm256_add_epi64(vpacket0, vpacketinc);
+                                    vpacket1 = _mm256_add_epi64(vpacket1, vpacketinc);
+                                    v1 = _mm256_srli_epi64(v0, P::YZBITS) & vxmask;
+                                    v5 = _mm256_srli_epi64(v4, P::YZBITS) & vxmask;
+                                    v0 = (v0 & vyzmask) | vhi0;
+                                    v4 = (v4 & vyzmask) | vhi1;
+                                    vhi0 = _mm256_add_epi64(vhi0, vhiinc);
+                                    vhi1 = _mm256_add_epi64(vhi1, vhiinc);
+
+                                    std::uint32_t ux;
+
+                                    store<0, 0>(base, ux, dst, wc, last, edge, v1, v0);
+                                    store<2, 1>(base, ux, dst, wc, last, edge, v1, v0);
+                                    store<4, 2>(base, ux, dst, wc, last, edge, v1, v0);
+                                    store<6, 3>(base, ux, dst, wc, last, edge, v1, v0);
+                                    store<0, 4>(base, ux, dst, wc, last, edge, v5, v4);
+                                    store<2, 5>(base, ux, dst, wc, last, edge, v5, v4);
+                                    store<4, 6>(base, ux, dst, wc, last, edge, v5, v4);
+                                    store<6, 7>(base, ux, dst, wc, last, edge, v5, v4);
+#elif NSIPHASH == 16
+                                    v0 = vinit0;
+                                    v1 = vinit1;
+                                    v2 = vinit2;
+                                    v3 = vinit3;
+                                    v4 = vinit0;
+                                    v5 = vinit1;
+                                    v6 = vinit2;
+                                    v7 = vinit3;
+
+                                    v3 = XOR16(v3, vpacket0);
+                                    v7 = XOR16(v7, vpacket1);
+                                    SIPROUNDX16;
+                                    SIPROUNDX16;
+                                    v0 = XOR16(v0, vpacket0);
+                                    v4 = XOR16(v4, vpacket1);
+                                    v2 = XOR16(v2, vff);
+                                    v6 = XOR16(v6, vff);
+                                    SIPROUNDX16;
+                                    SIPROUNDX16;
+                                    SIPROUNDX16;
+                                    SIPROUNDX16;
+                                    v0 = XOR16(XOR16(v0, v1), XOR16(v2, v3));
+                                    v4 = XOR16(XOR16(v4, v5), XOR16(v6, v7));
+
+                                    vpacket0 = ADD16(vpacket0, vpacketinc);
+                                    vpacket1 = ADD16(vpacket1, vpacketinc);
+                                    _mm512_store_si512((__m512i*)uxs, _mm512_srli_epi64(v0, P::YZBITS) & vxmask);
+                                    _mm512_store_si512((__m512i*)(uxs + 8), _mm512_srli_epi64(v4, P::YZBITS) & vxmask);
+                                    _mm512_store_si512((__m512i*)zzs, (v0 & vyzmask) | vhi0);
+                                    _mm512_store_si512((__m512i*)(zzs + 8), (v4 & vyzmask) | vhi1);
+                                    vhi0 = ADD16(vhi0, vhiinc);
+                                    vhi1 = ADD16(vhi1, vhiinc);
+
+                                    for (std::uint32_t i = 0; i < NSIPHASH; i++) {
+                                        store(base, dst, wc, last, edge, i, uxs[i], zzs[i]);
+                                    }
+#else
+#error not implemented
+#endif
+                                }
+
+                                if (P::NEEDSYNC) {
+                                    for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                        for (; last[ux] < endedge - P::NNONYZ; last[ux] += P::NNONYZ) {
+                                            scatter<std::uint32_t>(base, dst.index[ux], wc, ux, 0, P::BIGSIZE0);
+                                        }
+                                    }
+                                }
+
+                                unstage(base, dst, wc);
+                                sumsize += dst.storev(buckets, my);
+                            }
+                            fence(wc);
+                            tcounts[id] = sumsize / P::BIGSIZE0;
+                        }
+
+                        // Porcess butckets and discard nodes with one edge for it (means it won't be in a cycle)
+                        // Generate new paired nodes for remaining nodes generated in genUnodes step
+                        void genVnodes(const std::uint32_t id, const std::uint32_t uorv)
+                        {
+#if NSIPHASH == 8
+                            static const __m256i vxmask = {P::XMASK, P::XMASK, P::XMASK, P::XMASK};
+                            static const __m256i vyzmask = {P::YZMASK, P::YZMASK, P::YZMASK, P::YZMASK};
+                            const __m256i vinit = _mm256_set_epi64x(
+                                    sip_keys.k1 ^ 0x7465646279746573ULL,
+                                    sip_keys.k0 ^ 0x6c7967656e657261ULL,
+                                    sip_keys.k1 ^ 0x646f72616e646f6dULL,
+                                    sip_keys.k0 ^ 0x736f6d6570736575ULL);
+                            __m256i vpacket0, vpacket1, vhi0, vhi1;
+                            __m256i v0, v1, v2, v3, v4, v5, v6, v7;
+#elif NSIPHASH == 16
+                            const __m512i vxmask = _mm512_set1_epi64(P::XMASK);
+                            const __m512i vyzmask = _mm512_set1_epi64(P::YZMASK);
+                            const __m512i vinit0 = _mm512_set1_epi64(sip_keys.k0 ^ 0x736f6d6570736575ULL);
+                            const __m512i vinit1 = _mm512_set1_epi64(sip_keys.k1 ^ 0x646f72616e646f6dULL);
+                            const __m512i vinit2 = _mm512_set1_epi64(sip_keys.k0 ^ 0x6c7967656e657261ULL);
+                            const __m512i vinit3 = _mm512_set1_epi64(sip_keys.k1 ^ 0x7465646279746573ULL);
+                            const __m512i vff = _mm512_set1_epi64(0xff);
+                            const __m512i vuorv = _mm512_set1_epi64(uorv);
+                            __m512i vpacket0, vpacket1, vhi0, vhi1;
+                            __m512i v0, v1, v2, v3, v4, v5, v6, v7;
+                            alignas(64) std::uint64_t vxs[NSIPHASH];
+                            alignas(64) std::uint64_t ws[NSIPHASH];
+#endif
+
+                            static const std::uint32_t NONDEGBITS = std::min(40u, 2 * P::YZBITS) - P::ZBITS; // 28
+                            static const std::uint32_t NONDEGMASK = (1 << NONDEGBITS) - 1;
+                            indexerZ dst;
+                            indexerT small;
+                            wcline* wc = combiner(id);
+
+                            offset_t sumsize = 0;
+                            std::uint8_t const* base = (std::uint8_t*)buckets;
+                            std::uint8_t const* small0 = (std::uint8_t*)tbuckets[id];
+                            const std::uint32_t startux = P::NX * id / threads;
+                            const std::uint32_t endux = P::NX * (id + 1) / threads;
+
+                            for (std::uint32_t ux = startux; ux < endux; ux++) { // matrix x == ux
+                                small.matrixu(0);
+                                for (std::uint32_t my = 0; my < P::NY; my++) {
+                                    std::uint32_t edge = my << P::YZBITS;
+                                    std::uint8_t* readbig = buckets[ux][my].bytes;
+                                    std::uint8_t const* endreadbig = readbig + buckets[ux][my].size;
+                                    for (; readbig < endreadbig; readbig += P::BIGSIZE0) {
+                                        // bit     39/31..21     20..13    12..0
+                                        // read         edge     UYYYYY    UZZZZ   within UX partition
+                                        BIGTYPE0 e = *(BIGTYPE0*)readbig;
+                                        if (P::BIGSIZE0 > 4) {
+                                            e &= P::BIGSLOTMASK0;
+                                        } else if (P::NEEDSYNC) {
+                                            if (unlikely(!e)) {
+                                                edge += P::NNONYZ;
+                                                continue;
+                                            }
+                                        }
+                                        // restore edge generated in genUnodes
+                                        edge += ((std::uint32_t)(e >> P::YZBITS) - edge) & (P::NNONYZ - 1);
+                                        const std::uint32_t uy = (e >> P::ZBITS) & P::YMASK;
+                                        // bit         39..13     12..0
+                                        // write         edge     UZZZZ   within UX UY partition
+                                        *(std::uint64_t*)(small0 + small.index[uy]) = ((std::uint64_t)edge << P::ZBITS) | (e & P::ZMASK);
+                                        small.index[uy] += P::SMALLSIZE;
+                                    }
+                                }
+
+                                // counts of zz's for this ux
+                                std::uint8_t* degs = tdegs[id];
+                                small.storeu(tbuckets + id, 0);
+                                dst.matrixu(ux);
+                                stage(base, dst, wc);
+                                for (std::uint32_t uy = 0; uy < P::NY; uy++) {
+                                    memset(degs, 0xff, P::NZ);
+                                    std::uint8_t *readsmall = tbuckets[id][uy].bytes, *endreadsmall = readsmall + tbuckets[id][uy].size;
+
+                                    for (std::uint8_t* rdsmall = readsmall; rdsmall < endreadsmall; rdsmall += P::SMALLSIZE) {
+                                        degs[*(std::uint32_t*)rdsmall & P::ZMASK]++;
+                                    }
+
+                                    std::uint16_t* zs = tzs[id];
+                                    std::uint32_t* edges0;
+                                    edges0 = tedges[id]; // list of nodes with 2+ edges
+                                    std::uint32_t *edges = edges0, edge = 0;
+
+                                    for (std::uint8_t* rdsmall = readsmall; rdsmall < endreadsmall; rdsmall += P::SMALLSIZE) {
+                                        // bit         39..13     12..0
+                                        // read          edge     UZZZZ    sorted by UY within UX partition
+                                        const std::uint64_t e = *(std::uint64_t*)rdsmall;
+
+                                        edge += ((e >> P::ZBITS) - edge) & NONDEGMASK;
+                                        *edges = edge;
+                                        const std::uint32_t z = e & P::ZMASK;
+                                        *zs = z;
+
+                                        // check if array of ZZs counts (degs[]) has value not equal to 0 (means we have one edge for that node)
+                                        // if it's the only edge, then it would be rewritten in zs and edges arrays in next iteration (skipped)
+                                        const std::uint32_t delta = degs[z] ? 1 : 0;
+                                        edges += delta;
+                                        zs += delta;
+                                    }
+                                    assert(edges - edges0 < P::NTRIMMEDZ);
+                                    const std::uint16_t* readz = tzs[id];
+                                    const std::uint32_t* readedge = edges0;
+                                    std::int64_t uy34 = (std::int64_t)uy << P::YZZBITS;
+
+#if NSIPHASH == 8
+                                    const __m256i vuy34 = {uy34, uy34, uy34, uy34};
+                                    const __m256i vuorv = {uorv, uorv, uorv, uorv};
+                                    for (; readedge <= edges - NSIPHASH; readedge += NSIPHASH, readz += NSIPHASH) {
+                                        v3 = _mm256_permute4x64_epi64(vinit, 0xFF);
+                                        v0 = _mm256_permute4x64_epi64(vinit, 0x00);
+                                        v1 = _mm256_permute4x64_epi64(vinit, 0x55);
+                                        v2 = _mm256_permute4x64_epi64(vinit, 0xAA);
+                                        v7 = _mm256_permute4x64_epi64(vinit, 0xFF);
+                                        v4 = _mm256_permute4x64_epi64(vinit, 0x00);
+                                        v5 = _mm256_permute4x64_epi64(vinit, 0x55);
+                                        v6 = _mm256_permute4x64_epi64(vinit, 0xAA);
+
+                                        vpacket0 = _mm256_slli_epi64(_mm256_cvtepu32_epi64(*(__m128i*)readedge), 1) | vuorv;
+                                        vhi0 = vuy34 | _mm256_slli_epi64(_mm256_cvtepu16_epi64(_mm_set_epi64x(0, *(std::uint64_t*)readz)), P::YZBITS);
+                                        vpacket1 = _mm256_slli_epi64(_mm256_cvtepu32_epi64(*(__m128i*)(readedge + 4)), 1) | vuorv;
+                                        vhi1 = vuy34 | _mm256_slli_epi64(_mm256_cvtepu16_epi64(_mm_set_epi64x(0, *(std::uint64_t*)(readz + 4))), P::YZBITS);
+
+                                        v3 = XOR(v3, vpacket0);
+                                        v7 = XOR(v7, vpacket1);
+                                        SIPROUNDX8;
+                                        SIPROUNDX8;
+                                        v0 = XOR(v0, vpacket0);
+                                        v4 = XOR(v4, vpacket1);
+                                        v2 = XOR(v2, _mm256_broadcastq_epi64(_mm_cvtsi64_si128(0xff)));
+                                        v6 = XOR(v6, _mm256_broadcastq_epi64(_mm_cvtsi64_si128(0xff)));
+                                        SIPROUNDX8;
+                                        SIPROUNDX8;
+                                        SIPROUNDX8;
+                                        SIPROUNDX8;
+                                        v0 = XOR(XOR(v0, v1), XOR(v2, v3));
+                                        v4 = XOR(XOR(v4, v5), XOR(v6, v7));
+
+                                        v1 = _mm256_srli_epi64(v0, P::YZBITS) & vxmask;
+                                        v5 = _mm256_srli_epi64(v4, P::YZBITS) & vxmask;
+                                        v0 = vhi0 | (v0 & vyzmask);
+                                        v4 = vhi1 | (v4 & vyzmask);
+
+                                        std::uint32_t vx;
+#define STORE(i, v, x, w)                                                \
+                                        vx = _mm256_extract_epi32(v, x);                                     \
+                                        scatter<std::uint64_t>(base, dst.index[vx], wc, vx, _mm256_extract_epi64(w, i % 4), P::BIGSIZE);
+                                        STORE(0, v1, 0, v0);
+                                        STORE(1, v1, 2, v0);
+                                        STORE(2, v1, 4, v0);
+                                        STORE(3, v1, 6, v0);
+                                        STORE(4, v5, 0, v4);
+                                        STORE(5, v5, 2, v4);
+                                        STORE(6, v5, 4, v4);
+                                        STORE(7, v5, 6, v4);
+                                    }
+#elif NSIPHASH == 16
+                                    const __m512i vuy34 = _mm512_set1_epi64(uy34);
+                                    for (; readedge <= edges - NSIPHASH; readedge += NSIPHASH, readz += NSIPHASH) {
+                                        v0 = vinit0;
+                                        v1 = vinit1;
+                                        v2 = vinit2;
+                                        v3 = vinit3;
+                                        v4 = vinit0;
+                                        v5 = vinit1;
+                                        v6 = vinit2;
+                                        v7 = vinit3;
+
+                                        vpacket0 = _mm512_slli_epi64(_mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*)readedge)), 1) | vuorv;
+                                        vhi0 = vuy34 | _mm512_slli_epi64(_mm512_cvtepu16_epi64(_mm_loadu_si128((const __m128i*)readz)), P::YZBITS);
+                                        vpacket1 = _mm512_slli_epi64(_mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*)(readedge + 8))), 1) | vuorv;
+                                        vhi1 = vuy34 | _mm512_slli_epi64(_mm512_cvtepu16_epi64(_mm_loadu_si128((const __m128i*)(readz + 8))), P::YZBITS);
+
+                                        v3 = XOR16(v3, vpacket0);
+                                        v7 = XOR16(v7, vpacket1);
+                                        SIPROUNDX16;
+                                        SIPROUNDX16;
+                                        v0 = XOR16(v0, vpacket0);
+                                        v4 = XOR16(v4, vpacket1);
+                                        v2 = XOR16(v2, vff);
+                                        v6 = XOR16(v6, vff);
+                                        SIPROUNDX16;
+                                        SIPROUNDX16;
+                                        SIPROUNDX16;
+                                        SIPROUNDX16;
+                                        v0 = XOR16(XOR16(v0, v1), XOR16(v2, v3));
+                                        v4 = XOR16(XOR16(v4, v5), XOR16(v6, v7));
+
+                                        _mm512_store_si512((__m512i*)vxs, _mm512_srli_epi64(v0, P::YZBITS) & vxmask);
+                                        _mm512_store_si512((__m512i*)(vxs + 8), _mm512_srli_epi64(v4, P::YZBITS) & vxmask);
+                                        _mm512_store_si512((__m512i*)ws, vhi0 | (v0 & vyzmask));
+                                        _mm512_store_si512((__m512i*)(ws + 8), vhi1 | (v4 & vyzmask));
+
+                                        for (std::uint32_t i = 0; i < NSIPHASH; i++) {
+                                            scatter<std::uint64_t>(base, dst.index[vxs[i]], wc, vxs[i], ws[i], P::BIGSIZE);
+                                        }
+                                    }
+#endif
+
+                                    for (; readedge < edges; readedge++, readz++) { // process up to NSIPHASH-1 leftover edges
+                                        const std::uint32_t node = _sipnode(&sip_keys, P::EDGEMASK, *readedge, uorv);
+                                        const std::uint32_t vx = node >> P::YZBITS; // & XMASK;
+
+                                        // bit        39..34    33..21     20..13     12..0
+                                        // write      UYYYYY    UZZZZZ     VYYYYY     VZZZZ   within VX partition
+                                        // prev bucket info generated in genUnodes is overwritten here,
+                                        // as we store U and V nodes in one value (Yz and Zs; Xs are indices in a matrix)
+                                        // edge is discarded here, as we do not need it anymore
+                                        scatter<std::uint64_t>(base, dst.index[vx], wc, vx, uy34 | ((std::uint64_t)*readz << P::YZBITS) | (node & P::YZMASK), P::BIGSIZE);
+                                    }
+                                }
+                                unstage(base, dst, wc);
+                                sumsize += dst.storeu(buckets, ux);
+                            }
+                            fence(wc);
+                            tcounts[id] = sumsize / P::BIGSIZE;
+                        }
+
+                        template <std::uint32_t SRCSIZE, std::uint32_t DSTSIZE, bool TRIMONV>
+                            void trimedges(const std::uint32_t id, const std::uint32_t round)
+                            {
+                                const std::uint32_t SRCSLOTBITS = std::min(SRCSIZE * 8, 2 * P::YZBITS);
+                                const std::uint64_t SRCSLOTMASK = (1ULL << SRCSLOTBITS) - 1ULL;
+                                const std::uint32_t SRCPREFBITS = SRCSLOTBITS - P::YZBITS;
+                                const std::uint32_t SRCPREFMASK = (1 << SRCPREFBITS) - 1;
+                                const std::uint32_t DSTSLOTBITS = std::min(DSTSIZE * 8, 2 * P::YZBITS);
+                                const std::uint64_t DSTSLOTMASK = (1ULL << DSTSLOTBITS) - 1ULL;
+                                const std::uint32_t DSTPREFBITS = DSTSLOTBITS - P::YZZBITS;
+                                const std::uint32_t DSTPREFMASK = (1 << DSTPREFBITS) - 1;
+                                indexerZ dst;
+                                indexerT small;
+                                wcline* wc = combiner(id);
+
+                                offset_t sumsize = 0;
+                                std::uint8_t const* base = (std::uint8_t*)buckets;
+                                std::uint8_t const* small0 = (std::uint8_t*)tbuckets[id];
+                                const std::uint32_t startvx = P::NY * id / threads;
+                                const std::uint32_t endvx = P::NY * (id + 1) / threads;
+                                for (std::uint32_t vx = startvx; vx < endvx; vx++) {
+                                    small.matrixu(0);
+                                    for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                        std::uint32_t uxyz = ux << P::YZBITS;
+                                        zbucketZ& zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+                                        const std::uint8_t *readbig = zb.bytes, *endreadbig = readbig + zb.size;
+                                        for (; readbig < endreadbig; readbig += SRCSIZE) {
+                                            // bit        39..34    33..21     20..13     12..0
+                                            // write      UYYYYY    UZZZZZ     VYYYYY     VZZZZ   within VX partition
+                                            const std::uint64_t e = *(std::uint64_t*)readbig & SRCSLOTMASK;
+                                            uxyz += ((std::uint32_t)(e >> P::YZBITS) - uxyz) & SRCPREFMASK;
+                                            const std::uint32_t vy = (e >> P::ZBITS) & P::YMASK;
+                                            // bit     41/39..34    33..26     25..13     12..0
+                                            // write      UXXXXX    UYYYYY     UZZZZZ     VZZZZ   within VX VY partition
+                                            *(std::uint64_t*)(small0 + small.index[vy]) = ((std::uint64_t)uxyz << P::ZBITS) | (e & P::ZMASK);
+                                            uxyz &= ~P::ZMASK;
+                                            small.index[vy] += DSTSIZE;
+                                        }
+                                        if (unlikely(uxyz >> P::YZBITS != ux)) {
+                                            assert(false);
+                                        }
+                                    }
+                                    std::uint8_t* degs = tdegs[id];
+                                    small.storeu(tbuckets + id, 0);
+                                    TRIMONV ? dst.matrixv(vx) : dst.matrixu(vx);
+                                    stage(base, dst, wc);
+                                    for (std::uint32_t vy = 0; vy < P::NY; vy++) {
+                                        const std::uint64_t vy34 = (std::uint64_t)vy << P::YZZBITS;
+                                        memset(degs, 0xff, P::NZ);
+                                        std::uint8_t *readsmall = tbuckets[id][vy].bytes, *endreadsmall = readsmall + tbuckets[id][vy].size;
+                                        for (std::uint8_t* rdsmall = readsmall; rdsmall < endreadsmall; rdsmall += DSTSIZE)
+                                            degs[*(std::uint32_t*)rdsmall & P::ZMASK]++;
+                                        std::uint32_t ux = 0;
+                                        for (std::uint8_t* rdsmall = readsmall; rdsmall < endreadsmall; rdsmall += DSTSIZE) {
+                                            // bit     41/39..34    33..26     25..13     12..0
+                                            // read       UXXXXX    UYYYYY     UZZZZZ     VZZZZ   within VX VY partition
+                                            // bit        39..37    36..30     29..15     14..0      with XBITS==YBITS==7
+                                            // read       UXXXXX    UYYYYY     UZZZZZ     VZZZZ   within VX VY partition
+                                            const std::uint64_t e = *(std::uint64_t*)rdsmall & DSTSLOTMASK;
+                                            ux += ((std::uint32_t)(e >> P::YZZBITS) - ux) & DSTPREFMASK;
+                                            // bit    41/39..34    33..21     20..13     12..0
+                                            // write     VYYYYY    VZZZZZ     UYYYYY     UZZZZ   within UX partition
+                                            scatter<std::uint64_t>(base, dst.index[ux], wc, ux, vy34 | ((e & P::ZMASK) << P::YZBITS) | ((e >> P::ZBITS) & P::YZMASK), degs[e & P::ZMASK] ? DSTSIZE : 0);
+                                        }
+                                    }
+                                    unstage(base, dst, wc);
+                                    sumsize += TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
+                                }
+                                fence(wc);
+                                tcounts[id] = sumsize / DSTSIZE;
+                            }
+
+                        template <std::uint32_t SRCSIZE, std::uint32_t DSTSIZE, bool TRIMONV>
+                            void trimrename(const std::uint32_t id, const std::uint32_t round)
+                            {
+                                const std::uint32_t SRCSLOTBITS = std::min(SRCSIZE * 8, (TRIMONV ? P::YZBITS : P::YZ1BITS) + P::YZBITS);
+                                const std::uint64_t SRCSLOTMASK = (1ULL << SRCSLOTBITS) - 1ULL;
+                                const std::uint32_t SRCPREFBITS = SRCSLOTBITS - P::YZBITS;
+                                const std::uint32_t SRCPREFMASK = (1 << SRCPREFBITS) - 1;
+                                const std::uint32_t SRCPREFBITS2 = SRCSLOTBITS - P::YZZBITS;
+                                const std::uint32_t SRCPREFMASK2 = (1 << SRCPREFBITS2) - 1;
+                                indexerZ dst;
+                                indexerT small;
+                                static std::uint32_t maxnnid = 0;
+
+                                offset_t sumsize = 0;
+                                std::uint8_t const* base = (std::uint8_t*)buckets;
+                                std::uint8_t const* small0 = (std::uint8_t*)tbuckets[id];
+                                const std::uint32_t startvx = P::NY * id / threads;
+                                const std::uint32_t endvx = P::NY * (id + 1) / threads;
+                                for (std::uint32_t vx = startvx; vx < endvx; vx++) {
+                                    small.matrixu(0);
+                                    for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                        std::uint32_t uyz = 0;
+                                        zbucketZ& zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+                                        const std::uint8_t *readbig = zb.bytes, *endreadbig = readbig + zb.size;
+                                        for (; readbig < endreadbig; readbig += SRCSIZE) {
+                                            // bit        39..37    36..22     21..15     14..0
+                                            // write      UYYYYY    UZZZZZ     VYYYYY     VZZZZ   within VX partition  if TRIMONV
+                                            // bit            36...22     21..15     14..0
+                                            // write          VYYYZZ'     UYYYYY     UZZZZ   within UX partition  if !TRIMONV
+                                            const std::uint64_t e = *(std::uint64_t*)readbig & SRCSLOTMASK;
+                                            if (TRIMONV)
+                                                uyz += ((std::uint32_t)(e >> P::YZBITS) - uyz) & SRCPREFMASK;
+                                            else
+                                                uyz = e >> P::YZBITS;
+                                            const std::uint32_t vy = (e >> P::ZBITS) & P::YMASK;
+                                            // bit        39..37    36..30     29..15     14..0
+                                            // write      UXXXXX    UYYYYY     UZZZZZ     VZZZZ   within VX VY partition  if TRIMONV
+                                            // bit            36...30     29...15     14..0
+                                            // write          VXXXXXX     VYYYZZ'     UZZZZ   within UX UY partition  if !TRIMONV
+                                            *(std::uint64_t*)(small0 + small.index[vy]) = ((std::uint64_t)(ux << (TRIMONV ? P::YZBITS : P::YZ1BITS) | uyz) << P::ZBITS) | (e & P::ZMASK);
+                                            if (TRIMONV)
+                                                uyz &= ~P::ZMASK;
+                                            small.index[vy] += SRCSIZE;
+                                        }
+                                    }
+                                    std::uint16_t* degs = (std::uint16_t*)tdegs[id];
+                                    small.storeu(tbuckets + id, 0);
+                                    TRIMONV ? dst.matrixv(vx) : dst.matrixu(vx);
+                                    std::uint32_t newnodeid = 0;
+                                    std::uint32_t* renames = TRIMONV ? buckets[0][vx].renamev : buckets[vx][0].renameu;
+                                    std::uint32_t* endrenames = renames + P::NZ1;
+                                    for (std::uint32_t vy = 0; vy < P::NY; vy++) {
+                                        memset(degs, 0xff, 2 * P::NZ);
+                                        std::uint8_t *readsmall = tbuckets[id][vy].bytes, *endreadsmall = readsmall + tbuckets[id][vy].size;
+                                        for (std::uint8_t* rdsmall = readsmall; rdsmall < endreadsmall; rdsmall += SRCSIZE)
+                                            degs[*(std::uint32_t*)rdsmall & P::ZMASK]++;
+                                        std::uint32_t ux = 0;
+                                        std::uint32_t nrenames = 0;
+                                        for (std::uint8_t* rdsmall = readsmall; rdsmall < endreadsmall; rdsmall += SRCSIZE) {
+                                            // bit        39..37    36..30     29..15     14..0
+                                            // read       UXXXXX    UYYYYY     UZZZZZ     VZZZZ   within VX VY partition  if TRIMONV
+                                            // bit            36...30     29...15     14..0
+                                            // read           VXXXXXX     VYYYZZ'     UZZZZ   within UX UY partition  if !TRIMONV
+                                            const std::uint64_t e = *(std::uint64_t*)rdsmall & SRCSLOTMASK;
+                                            if (TRIMONV)
+                                                ux += ((std::uint32_t)(e >> P::YZZBITS) - ux) & SRCPREFMASK2;
+                                            else
+                                                ux = e >> P::YZZ1BITS;
+                                            const std::uint32_t vz = e & P::ZMASK;
+                                            std::uint16_t vdeg = degs[vz];
+                                            if (vdeg) {
+                                                if (vdeg < 32) {
+                                                    degs[vz] = vdeg = 32 + nrenames++;
+                                                    *renames++ = vy << P::ZBITS | vz;
+                                                    if (renames == endrenames) {
+                                                        endrenames += (TRIMONV ? sizeof(yzbucketZ) : sizeof(zbucketZ)) / sizeof(std::uint32_t);
+                                                        renames = endrenames - P::NZ1;
+                                                    }
+                                                }
+                                                // bit       36..22     21..15     14..0
+                                                // write     VYYZZ'     UYYYYY     UZZZZ   within UX partition  if TRIMONV
+                                                if (TRIMONV)
+                                                    *(std::uint64_t*)(base + dst.index[ux]) = ((std::uint64_t)(newnodeid + vdeg - 32) << P::YZBITS) | ((e >> P::ZBITS) & P::YZMASK);
+                                                else
+                                                    *(std::uint32_t*)(base + dst.index[ux]) = ((newnodeid + vdeg - 32) << P::YZ1BITS) | ((e >> P::ZBITS) & P::YZ1MASK);
+                                                dst.index[ux] += DSTSIZE;
+                                            }
+                                        }
+                                        newnodeid += nrenames;
+                                        if (TRIMONV && unlikely(ux >> SRCPREFBITS2 != P::XMASK >> SRCPREFBITS2)) {
+                                            assert(false);
+                                        }
+                                    }
+                                    if (newnodeid > maxnnid)
+                                        maxnnid = newnodeid;
+                                    sumsize += TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
+                                }
+                                assert(maxnnid < P::NYZ1);
+                                tcounts[id] = sumsize / DSTSIZE;
+                            }
+
+                        template <bool TRIMONV>
+                            void trimedges1(const std::uint32_t id, const std::uint32_t round)
+                            {
+                                indexerZ dst;
+
+                                offset_t sumsize = 0;
+                                std::uint8_t* degs = tdegs[id];
+                                std::uint8_t const* base = (std::uint8_t*)buckets;
+                                const std::uint32_t startvx = P::NY * id / threads;
+                                const std::uint32_t endvx = P::NY * (id + 1) / threads;
+                                for (std::uint32_t vx = startvx; vx < endvx; vx++) {
+                                    TRIMONV ? dst.matrixv(vx) : dst.matrixu(vx);
+                                    memset(degs, 0xff, P::NYZ1);
+                                    for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                        zbucketZ& zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+                                        std::uint32_t *readbig = zb.words, *endreadbig = readbig + zb.size / sizeof(std::uint32_t);
+                                        for (; readbig < endreadbig; readbig++)
+                                            degs[*readbig & P::YZ1MASK]++;
+                                    }
+                                    for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                        zbucketZ& zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+                                        std::uint32_t *readbig = zb.words, *endreadbig = readbig + zb.size / sizeof(std::uint32_t);
+                                        for (; readbig < endreadbig; readbig++) {
+                                            // bit       29..22    21..15     14..7     6..0
+                                            // read      UYYYYY    UZZZZ'     VYYYY     VZZ'   within VX partition
+                                            const std::uint32_t e = *readbig;
+                                            const std::uint32_t vyz = e & P::YZ1MASK;
+                                            // bit       29..22    21..15     14..7     6..0
+                                            // write     VYYYYY    VZZZZ'     UYYYY     UZZ'   within UX partition
+                                            *(std::uint32_t*)(base + dst.index[ux]) = (vyz << P::YZ1BITS) | (e >> P::YZ1BITS);
+                                            dst.index[ux] += degs[vyz] ? sizeof(std::uint32_t) : 0;
+                                        }
+                                    }
+                                    sumsize += TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
+                                }
+                                tcounts[id] = sumsize / sizeof(std::uint32_t);
+                            }
+
+                        template <bool TRIMONV>
+                            void trimrename1(const std::uint32_t id, const std::uint32_t round)
+                            {
+                                indexerZ dst;
+                                static std::uint32_t maxnnid = 0;
+
+                                offset_t sumsize = 0;
+                                std::uint16_t* degs = (std::uint16_t*)tdegs[id];
+                                std::uint8_t const* base = (std::uint8_t*)buckets;
+                                const std::uint32_t startvx = P::NY * id / threads;
+                                const std::uint32_t endvx = P::NY * (id + 1) / threads;
+                                for (std::uint32_t vx = startvx; vx < endvx; vx++) {
+                                    TRIMONV ? dst.matrixv(vx) : dst.matrixu(vx);
+                                    memset(degs, 0xff, 2 * P::NYZ1);
+                                    for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                        zbucketZ& zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+                                        std::uint32_t *readbig = zb.words, *endreadbig = readbig + zb.size / sizeof(std::uint32_t);
+                                        for (; readbig < endreadbig; readbig++)
+                                            degs[*readbig & P::YZ1MASK]++;
+                                    }
+                                    std::uint32_t newnodeid = 0;
+                                    std::uint32_t* renames = TRIMONV ? buckets[0][vx].renamev1 : buckets[vx][0].renameu1;
+                                    std::uint32_t* endrenames = renames + P::NZ2;
+                                    for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                        zbucketZ& zb = TRIMONV ? buckets[ux][vx] : buckets[vx][ux];
+                                        std::uint32_t *readbig = zb.words, *endreadbig = readbig + zb.size / sizeof(std::uint32_t);
+                                        for (; readbig < endreadbig; readbig++) {
+                                            // bit       29...15     14...0
+                                            // read      UYYYZZ'     VYYZZ'   within VX partition
+                                            const std::uint32_t e = *readbig;
+                                            const std::uint32_t vyz = e & P::YZ1MASK;
+                                            std::uint16_t vdeg = degs[vyz];
+                                            if (vdeg) {
+                                                if (vdeg < 32) {
+                                                    degs[vyz] = vdeg = 32 + newnodeid++;
+                                                    *renames++ = vyz;
+                                                    if (renames == endrenames) {
+                                                        endrenames += (TRIMONV ? sizeof(yzbucketZ) : sizeof(zbucketZ)) / sizeof(std::uint32_t);
+                                                        renames = endrenames - P::NZ2;
+                                                    }
+                                                }
+                                                // bit       25...15     14...0
+                                                // write     VYYZZZ"     UYYZZ'   within UX partition
+                                                *(std::uint32_t*)(base + dst.index[ux]) = ((vdeg - 32) << (TRIMONV ? P::YZ1BITS : P::YZ2BITS)) | (e >> P::YZ1BITS);
+                                                dst.index[ux] += sizeof(std::uint32_t);
+                                            }
+                                        }
+                                    }
+                                    if (newnodeid > maxnnid)
+                                        maxnnid = newnodeid;
+                                    sumsize += TRIMONV ? dst.storev(buckets, vx) : dst.storeu(buckets, vx);
+                                }
+                                assert(maxnnid < P::NYZ2);
+                                tcounts[id] = sumsize / sizeof(std::uint32_t);
+                            }
+
+                        void trim(const util::CancelToken& cancelIn)
+                        {
+                            lastcount = 0;
+                            trimmed = false;
+                            rounds = nTrims;
+                            cancel = &cancelIn;
+                            stale = false;
+
+                            if (telemetry) {
+                                stages = GraphTelemetry{};
+                                stagestart = std::chrono::steady_clock::now();
+                            }
+
+                            if (threads == 1) {
+                                trimmer(0);
+                                if (telemetry) {
+                                    mark();
+                                }
+                                return;
+                            }
+
+                            std::vector<std::future<void>> jobs;
+                            for (int t = 0; t < threads; t++) {
+                                jobs.push_back(
+                                        pool.push([this, t](int id) {
+                                            util::ScopedPin pinned{cpus};
+                                            etworker<offset_t, EDGEBITS, XBITS>(this, t);
+                                            }));
+                            }
+
+                            for(auto& j : jobs) {
+                                j.wait();
+                            }
+
+                            if (telemetry) {
+                                mark();
+                            }
+                        }
+
+                        void trimmer(std::uint32_t id)
+                        {
+                            genUnodes(id, 0);
+                            barry->wait([this] {
+                                    if (telemetry) {
+                                        mark();
+                                    }
+                                    stale = cancel->cancelled();
+                                    if (stale) {
+                                        rounds = 1;
+                                    }
+                                    });
+                            if (stale) {
+                                return;
+                            }
+                            genVnodes(id, 1);
+                            for (std::uint32_t round = 2; round < nTrims - 2; round += 2) {
+                                barry->wait([this, round] {
+                                        if (telemetry) {
+                                            mark();
+                                        }
+                                        stale = cancel->cancelled();
+                                        if (stale) {
+                                            rounds = round;
+                                        } else if (stopRate > 0 && round > P::COMPRESSROUND) {
+                                            trimmed = trimmed_enough();
+                                            if (trimmed) {
+                                                rounds = round + 2;
+                                            }
+                                        }
+                                        });
+                                if (stale) {
+                                    return;
+                                }
+                                if (trimmed) {
+                                    break;
+                                }
+                                if (round < P::COMPRESSROUND) {
+                                    if (round < P::EXPANDROUND)
+                                        trimedges<P::BIGSIZE, P::BIGSIZE, true>(id, round);
+                                    else if (round == P::EXPANDROUND)
+                                        trimedges<P::BIGSIZE, P::BIGGERSIZE, true>(id, round);
+                                    else
+                                        trimedges<P::BIGGERSIZE, P::BIGGERSIZE, true>(id, round);
+                                } else if (round == P::COMPRESSROUND) {
+                                    trimrename<P::BIGGERSIZE, P::BIGGERSIZE, true>(id, round);
+                                } else
+                                    trimedges1<true>(id, round);
+                                endstage();
+                                if (round < P::COMPRESSROUND) {
+                                    if (round + 1 < P::EXPANDROUND)
+                                        trimedges<P::BIGSIZE, P::BIGSIZE, false>(id, round + 1);
+                                    else if (round + 1 == P::EXPANDROUND)
+                                        trimedges<P::BIGSIZE, P::BIGGERSIZE, false>(id, round + 1);
+                                    else
+                                        trimedges<P::BIGGERSIZE, P::BIGGERSIZE, false>(id, round + 1);
+                                } else if (round == P::COMPRESSROUND) {
+                                    trimrename<P::BIGGERSIZE, sizeof(std::uint32_t), false>(id, round + 1);
+                                } else
+                                    trimedges1<false>(id, round + 1);
+                            }
+                            // an early stop already closed the last stage
+                            if (trimmed) {
+                                barry->wait();
+                            } else {
+                                endstage();
+                            }
+                            trimrename1<true>(id, nTrims - 2);
+                            endstage();
+                            trimrename1<false>(id, nTrims - 1);
+                        }
+                };
+
+            template <typename offset_t, std::uint8_t EDGEBITS, std::uint8_t XBITS>
+                class solver_ctx : public solver_base
+                {
+                    public:
+                        using P = Params<EDGEBITS, XBITS>;
+                        using zbucket8P = zbucket8<EDGEBITS, XBITS>;
+                        using zbucket16P = zbucket16<EDGEBITS, XBITS>;
+                        using zbucket32P = zbucket32<EDGEBITS, XBITS>;
+                        using zbucketZ = zbucket<EDGEBITS, XBITS, P::ZBUCKETSIZE>;
+                        using yzbucketT = yzbucket<EDGEBITS, XBITS, P::TBUCKETSIZE>;
+
+                        edgetrimmer<offset_t, EDGEBITS, XBITS>* trimmer;
+                        std::uint32_t* cuckoo = 0;
+                        // what matchUnodes needs to turn the nodes of a graph's
+                        // cycles back into edges. the cycles are laid out one
+                        // after the other, proofSize nodes each, and all of them
+                        // are recovered in a single sweep over the edges.
+                        struct match_state
+                        {
+                            crypto::siphash_keys sip_keys;
+                            std::bitset<P::NXY> uxymap;
+                            std::vector<std::uint32_t> cycleus;
+                            std::vector<std::uint32_t> cyclevs;
+                            std::uint32_t* sol;
+                        };
+
+                        match_state match;
+
+                        // a trimmed graph handed to a finder thread so the
+                        // trimmer can move on to the next one
+                        struct graph
+                        {
+                            match_state match;
+                            std::vector<std::uint32_t> unodes;
+                            std::vector<std::uint32_t> vnodes;
+                            std::shared_future<Cycles> cycles;
+                        };
+
+                        graph graphs[2];
+                        std::uint32_t nextgraph = 0;
+
+                        // parallel cycle search. the trimmed graph is split
+                        // into connected components with a lock free union
+                        // find, and each component is walked by one thread in
+                        // the serial edge order so the cycles don't change.
+                        struct found_cycle
+                        {
+                            std::uint64_t order; // source thread, then edge index
+                            std::uint32_t nu, nv;
+                            std::vector<std::uint32_t> us, vs;
+                        };
+
+                        std::unique_ptr<std::atomic<std::uint32_t>[]> forest;
+                        std::vector<std::vector<std::uint64_t>> edges;     // per thread, in serial order
+                        std::vector<std::vector<std::uint32_t>> routed;    // [from * threads + to] edge indices
+                        std::vector<std::vector<found_cycle>> found;      // per thread
+                        std::vector<std::uint32_t> sols; // concatanation of all proof's indices
+                        ctpl::thread_pool& pool;
+                        size_t threads;
+                        std::uint8_t proofSize;
+
+                        solver_ctx(
+                                ctpl::thread_pool& poolIn,
+                                size_t threadsIn,
+                                const std::uint32_t nTrims,
+                                const std::uint8_t proofSizeIn,
+                                const SolverOptions& options) : pool{poolIn}, threads{threadsIn}, proofSize{proofSizeIn}
+                        {
+                            trimmer = new edgetrimmer<offset_t, EDGEBITS, XBITS>(pool, threadsIn, nTrims, options);
+
+                            if (threads > 1 && options.parallel_cycles) {
+                                forest.reset(new std::atomic<std::uint32_t>[P::CUCKOO_SIZE]);
+                                edges.resize(threads);
+                                routed.resize(threads * threads);
+                                found.resize(threads);
+                            }
+
+                            cuckoo = 0;
+                        }
+
+                        ~solver_ctx()
+                        {
+                            for (auto& g : graphs) {
+                                if (g.cycles.valid()) {
+                                    g.cycles.wait();
+                                }
+                            }
+                            delete trimmer;
+                        }
+
+                        // re-key the trimmer for a new graph and forget the previous
+                        // graph's solutions. bucket sizes are rewritten by genUnodes.
+                        void setkeys(const crypto::siphash_keys& keys)
+                        {
+                            trimmer->sip_keys = keys;
+                            sols.clear();
+                            match.uxymap.reset();
+                            match.cycleus.clear();
+                            match.cyclevs.clear();
+                        }
+
+                        bool find_cycles(
+                                const crypto::siphash_keys& keys,
+                                Cycles& cycles,
+                                const util::CancelToken& cancel) override
+                        {
+                            setkeys(keys);
+
+                            bool found = solve(cancel);
+
+                            if (found) {
+                                for(int i = 0; i < sols.size() / proofSize; i++) {
+                                    Cycle cycle;
+                                    copy(
+                                            sols.begin() + (i * proofSize),
+                                            sols.begin() + (i * proofSize) + proofSize,
+                                            inserter(cycle, cycle.begin()));
+                                    cycles.emplace_back(cycle);
+                                }
+                            }
+
+                            return found;
+                        }
+
+                        util::PageBacking page_backing() const override
+                        {
+                            return trimmer->backing();
+                        }
+
+                        std::uint32_t trim_rounds() const override
+                        {
+                            return trimmer->rounds;
+                        }
+
+                        bool aborted() const override
+                        {
+                            return trimmer->stale;
+                        }
+
+                        const GraphTelemetry* telemetry() const override
+                        {
+                            return trimmer->telemetry ? &trimmer->stages : nullptr;
+                        }
+
+                        std::shared_future<Cycles> find_cycles_async(
+                                const char* header,
+                                const std::uint32_t headerlen,
+                                const util::CancelToken& cancel) override
+                        {
+                            assert(header != nullptr);
+                            assert(headerlen > 0);
+
+                            crypto::siphash_keys keys;
+                            setHeader(header, headerlen, &keys);
+                            setkeys(keys);
+                            trimmer->trim(cancel);
+                            if (trimmer->stale) {
+                                std::promise<Cycles> none;
+                                none.set_value(Cycles{});
+                                return none.get_future().share();
+                            }
+
+                            // the finder of the graph before last may still
+                            // be reading this slot
+                            graph& g = graphs[nextgraph];
+                            nextgraph ^= 1;
+                            if (g.cycles.valid()) {
+                                g.cycles.wait();
+                            }
+
+                            extract(g);
+                            g.cycles = pool.push([this, &g](int id) {
+                                    util::ScopedPin pinned{trimmer->cpus};
+                                    return findgraph(g);
+                                    }).share();
+                            return g.cycles;
+                        }
+
+                        // copies the surviving edges out of the buckets with
+                        // full node ids, in the order findcycles visits them.
+                        void extract(graph& g) const
+                        {
+                            g.match.sip_keys = trimmer->sip_keys;
+                            g.unodes.clear();
+                            g.vnodes.clear();
+
+                            for (std::uint32_t vx = 0; vx < P::NX; vx++) {
+                                for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                    const zbucketZ& zb = trimmer->buckets[ux][vx];
+                                    const std::uint32_t *readbig = zb.words, *endreadbig = readbig + zb.size / sizeof(std::uint32_t);
+                                    for (; readbig < endreadbig; readbig++) {
+                                        const std::uint32_t e = *readbig;
+                                        const std::uint32_t uxyz = (ux << P::YZ2BITS) | (e >> P::YZ2BITS);
+                                        const std::uint32_t vxyz = (vx << P::YZ2BITS) | (e & P::YZ2MASK);
+
+                                        std::uint32_t u, v;
+                                        fullnodes(uxyz << 1, (vxyz << 1) | 1, u, v);
+                                        g.unodes.push_back(u);
+                                        g.vnodes.push_back(v);
+                                    }
+                                }
+                            }
+                        }
+
+                        // finds the cycles of an extracted graph and recovers
+                        // their edges on the calling thread alone.
+                        Cycles findgraph(graph& g)
+                        {
+                            const auto found = find_cycle_indices(g.unodes, g.vnodes, proofSize);
+                            g.match.uxymap.reset();
+                            g.match.cycleus.clear();
+                            g.match.cyclevs.clear();
+                            for (const auto& indices : found) {
+                                for (std::uint32_t j = 0; j < proofSize; j++) {
+                                    g.match.cycleus.push_back(g.unodes[indices[j]] / 2);
+                                    g.match.cyclevs.push_back(g.vnodes[indices[j]] / 2);
+                                    g.match.uxymap[g.match.cycleus.back() >> P::ZBITS] = 1;
+                                }
+                            }
+
+                            Cycles cycles;
+                            if (found.empty()) {
+                                return cycles;
+                            }
+
+                            std::vector<std::uint32_t> sol(g.match.cycleus.size());
+                            g.match.sol = sol.data();
+                            matchUnodes(g.match, 0, 1);
+                            for (auto start = sol.begin(); start != sol.end(); start += proofSize) {
+                                cycles.emplace_back(start, start + proofSize);
+                            }
+                            return cycles;
+                        }
+
+                        std::uint64_t sharedbytes() const
+                        {
+                            return sizeof(matrix<EDGEBITS, XBITS, P::ZBUCKETSIZE>);
+                        }
+
+                        std::uint32_t threadbytes() const
+                        {
+                            return sizeof(yzbucketT) + sizeof(zbucket8P) + sizeof(zbucket16P) + sizeof(zbucket32P);
+                        }
+
+                        // maps renamed trimmed nodes back to full node ids
+                        void fullnodes(const std::uint32_t u2, const std::uint32_t v2, std::uint32_t& u, std::uint32_t& v) const
+                        {
+                            const std::uint32_t u1 = u2 / 2;
+                            const std::uint32_t ux = u1 >> P::YZ2BITS;
+                            std::uint32_t uyz = trimmer->buckets[ux][(u1 >> P::Z2BITS) & P::YMASK].renameu1[u1 & P::Z2MASK];
+                            assert(uyz < P::NYZ1);
+                            const std::uint32_t v1 = v2 / 2;
+                            const std::uint32_t vx = v1 >> P::YZ2BITS;
+                            std::uint32_t vyz = trimmer->buckets[(v1 >> P::Z2BITS) & P::YMASK][vx].renamev1[v1 & P::Z2MASK];
+                            assert(vyz < P::NYZ1);
+
+                            if (P::COMPRESSROUND > 0) {
+                                uyz = trimmer->buckets[ux][uyz >> P::Z1BITS].renameu[uyz & P::Z1MASK];
+                                vyz = trimmer->buckets[vyz >> P::Z1BITS][vx].renamev[vyz & P::Z1MASK];
+                            }
+
+                            u = ((ux << P::YZBITS) | uyz) << 1;
+                            v = ((vx << P::YZBITS) | vyz) << 1 | 1;
+                        }
+
+                        void recordedge(const std::uint32_t u2, const std::uint32_t v2)
+                        {
+                            std::uint32_t u, v;
+                            fullnodes(u2, v2, u, v);
+
+                            match.cycleus.push_back(u / 2);
+                            match.cyclevs.push_back(v / 2);
+                            match.uxymap[u / 2 >> P::ZBITS] = 1;
+                        }
+
+                        // queues a cycle's nodes; its edges are recovered
+                        // together with the others' once the search is done
+                        void solution(const std::uint32_t* us, std::uint32_t nu, const std::uint32_t* vs, std::uint32_t nv)
+                        {
+                            recordedge(*us, *vs);
+                            while (nu--)
+                                recordedge(us[(nu + 1) & ~1], us[nu | 1]); // u's in even position; v's in odd
+                            while (nv--)
+                                recordedge(vs[nv | 1], vs[(nv + 1) & ~1]); // u's in odd position; v's in even
+                        }
+
+                        // turns every queued cycle back into edge indices with
+                        // one siphash sweep over the edges, however many there are
+                        void recover()
+                        {
+                            const auto matchstart = trimmer->telemetry ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+                            sols.resize(match.cycleus.size());
+                            match.sip_keys = trimmer->sip_keys;
+                            match.sol = sols.data();
+
+                            // a single thread matches inline, like trim, so
+                            // batched solvers never wait on the pool they run on
+                            if (threads == 1) {
+                                matchworker<offset_t, EDGEBITS, XBITS>(this, 0);
+                            } else {
+                                std::vector<std::future<void>> jobs;
+                                for (size_t t = 0; t < threads; t++) {
+                                    jobs.push_back(
+                                            pool.push(
+                                                [this, t](int id) {
+                                                    util::ScopedPin pinned{trimmer->cpus};
+                                                    matchworker<offset_t, EDGEBITS, XBITS>(this, t);
+                                                }));
+                                }
+
+                                for (auto& j : jobs) {
+                                    j.wait();
+                                }
+                            }
+
+                            for (auto start = sols.begin(); start != sols.end(); start += proofSize) {
+                                std::sort(start, start + proofSize);
+                            }
+
+                            if (trimmer->telemetry) {
+                                trimmer->stages.match_time += std::chrono::steady_clock::now() - matchstart;
+                            }
+                        }
+
+                        static const std::uint32_t CUCKOO_NIL = ~0;
+
+                        std::uint32_t path(std::uint32_t u, std::uint32_t* us) const
+                        {
+                            std::uint32_t nu, u0 = u;
+                            for (nu = 0; u != CUCKOO_NIL; u = cuckoo[u]) {
+                                if (nu >= MAXPATHLEN) {
+                                    while (nu-- && us[nu] != u)
+                                        ;
+                                    break;
+                                }
+                                us[nu++] = u;
+                            }
+                            return nu - 1;
+                        }
+
+                        bool findcycles()
+                        {
+                            std::uint32_t us[MAXPATHLEN], vs[MAXPATHLEN];
+
+                            bool found = false;
+                            for (std::uint32_t vx = 0; vx < P::NX; vx++) {
+                                if (trimmer->cancel->cancelled()) {
+                                    trimmer->stale = true;
+                                    return false;
+                                }
+                                for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                    zbucketZ& zb = trimmer->buckets[ux][vx];
+                                    std::uint32_t *readbig = zb.words, *endreadbig = readbig + zb.size / sizeof(std::uint32_t);
+                                    for (; readbig < endreadbig; readbig++) {
+                                        // bit        21..11     10...0
+                                        // write      UYYZZZ'    VYYZZ'   within VX partition
+                                        const std::uint32_t e = *readbig;
+                                        const std::uint32_t uxyz = (ux << P::YZ2BITS) | (e >> P::YZ2BITS);
+                                        const std::uint32_t vxyz = (vx << P::YZ2BITS) | (e & P::YZ2MASK);
+
+                                        const std::uint32_t u0 = uxyz << 1, v0 = (vxyz << 1) | 1;
+                                        if (u0 != CUCKOO_NIL) {
+                                            std::uint32_t nu = path(u0, us);
+                                            std::uint32_t nv = path(v0, vs);
+                                            if (us[nu] == vs[nv]) {
+                                                const std::uint32_t min = nu < nv ? nu : nv;
+                                                for (nu -= min, nv -= min; us[nu] != vs[nv]; nu++, nv++)
+                                                    ;
+                                                const std::uint32_t len = nu + nv + 1;
+                                                if (len == proofSize) {
+                                                    solution(us, nu, vs, nv);
+                                                    found = true;
+                                                }
+                                            } else if (nu < nv) {
+                                                while (nu--)
+                                                    cuckoo[us[nu + 1]] = us[nu];
+                                                cuckoo[u0] = v0;
+                                            } else {
+                                                while (nv--)
+                                                    cuckoo[vs[nv + 1]] = vs[nv];
+                                                cuckoo[v0] = u0;
+                                            }
+                                        }
+                                    }
+                                }
+                            }
+
+                            return found;
+                        }
+
+                        bool solve(const util::CancelToken& cancel)
+                        {
+                            assert((std::uint64_t)P::CUCKOO_SIZE * sizeof(std::uint32_t) <= trimmer->threads * sizeof(yzbucketT));
+                            trimmer->trim(cancel);
+                            if (trimmer->stale) {
+                                return false;
+                            }
+                            const auto findstart = trimmer->telemetry ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+                            cuckoo = (std::uint32_t*)trimmer->tbuckets;
+                            bool found;
+                            if (forest) {
+                                found = findcycles_parallel();
+                            } else {
+                                memset(cuckoo, CUCKOO_NIL, P::CUCKOO_SIZE * sizeof(std::uint32_t));
+                                found = findcycles();
+                            }
+
+                            if (trimmer->telemetry) {
+                                trimmer->stages.find_time = std::chrono::steady_clock::now() - findstart;
+                            }
+
+                            // the recovery is another sweep over every edge,
+                            // not worth it for cycles nobody will submit
+                            if (found && cancel.cancelled()) {
+                                trimmer->stale = true;
+                                return false;
+                            }
+                            if (found) {
+                                recover();
+                            }
+                            return found;
+                        }
+
+                        std::uint32_t findroot(std::uint32_t x)
+                        {
+                            while (true) {
+                                std::uint32_t p = forest[x].load(std::memory_order_relaxed);
+                                if (p == x) {
+                                    return x;
+                                }
+                                // path halving, a lost race only skips a shortcut
+                                const std::uint32_t gp = forest[p].load(std::memory_order_relaxed);
+                                if (gp != p) {
+                                    forest[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+                                }
+                                x = gp;
+                            }
+                        }
+
+                        void unite(std::uint32_t a, std::uint32_t b)
+                        {
+                            while (true) {
+                                a = findroot(a);
+                                b = findroot(b);
+                                if (a == b) {
+                                    return;
+                                }
+                                // links always point to the smaller root so
+                                // concurrent unions can't form a loop
+                                if (a < b) {
+                                    std::swap(a, b);
+                                }
+                                std::uint32_t expected = a;
+                                if (forest[a].compare_exchange_weak(expected, b)) {
+                                    return;
+                                }
+                            }
+                        }
+
+                        void findcycles(const std::uint32_t id)
+                        {
+                            const std::uint32_t nthreads = threads;
+                            const std::uint32_t startn = static_cast<std::uint64_t>(P::CUCKOO_SIZE) * id / nthreads;
+                            const std::uint32_t endn = static_cast<std::uint64_t>(P::CUCKOO_SIZE) * (id + 1) / nthreads;
+                            for (std::uint32_t n = startn; n < endn; n++) {
+                                forest[n].store(n, std::memory_order_relaxed);
+                            }
+                            memset(cuckoo + startn, CUCKOO_NIL, (endn - startn) * sizeof(std::uint32_t));
+                            trimmer->barry->wait();
+
+                            // collect this thread's share of the edges in the
+                            // order findcycles visits them and join their nodes
+                            auto& mine = edges[id];
+                            mine.clear();
+                            const std::uint32_t startvx = P::NX * id / nthreads;
+                            const std::uint32_t endvx = P::NX * (id + 1) / nthreads;
+                            for (std::uint32_t vx = startvx; vx < endvx; vx++) {
+                                for (std::uint32_t ux = 0; ux < P::NX; ux++) {
+                                    const zbucketZ& zb = trimmer->buckets[ux][vx];
+                                    const std::uint32_t *readbig = zb.words, *endreadbig = readbig + zb.size / sizeof(std::uint32_t);
+                                    for (; readbig < endreadbig; readbig++) {
+                                        const std::uint32_t e = *readbig;
+                                        const std::uint32_t uxyz = (ux << P::YZ2BITS) | (e >> P::YZ2BITS);
+                                        const std::uint32_t vxyz = (vx << P::YZ2BITS) | (e & P::YZ2MASK);
+                                        const std::uint32_t u0 = uxyz << 1, v0 = (vxyz << 1) | 1;
+                                        mine.push_back(std::uint64_t{u0} << 32 | v0);
+                                        unite(u0, v0);
+                                    }
+                                }
+                            }
+
+                            // like the trimming rounds, the last thread in
+                            // decides for all of them whether to give up
+                            trimmer->barry->wait([this] {
+                                    trimmer->stale = trimmer->cancel->cancelled();
+                                    });
+                            if (trimmer->stale) {
+                                return;
+                            }
+
+                            // hand every edge to the thread owning its component
+                            for (std::uint32_t to = 0; to < nthreads; to++) {
+                                routed[id * nthreads + to].clear();
+                            }
+                            for (std::uint32_t i = 0; i < mine.size(); i++) {
+                                const std::uint32_t root = findroot(mine[i] >> 32);
+                                routed[id * nthreads + root % nthreads].push_back(i);
+                            }
+                            trimmer->barry->wait([this] {
+                                    trimmer->stale = trimmer->cancel->cancelled();
+                                    });
+                            if (trimmer->stale) {
+                                return;
+                            }
+
+                            // components share no nodes, so the threads can walk
+                            // the one cuckoo array side by side
+                            std::vector<std::uint32_t> usbuf(MAXPATHLEN), vsbuf(MAXPATHLEN);
+                            std::uint32_t* us = usbuf.data();
+                            std::uint32_t* vs = vsbuf.data();
+                            found[id].clear();
+                            for (std::uint32_t from = 0; from < nthreads; from++) {
+                                for (const std::uint32_t i : routed[from * nthreads + id]) {
+                                    const std::uint64_t edge = edges[from][i];
+                                    const std::uint32_t u0 = edge >> 32, v0 = static_cast<std::uint32_t>(edge);
+                                    std::uint32_t nu = path(u0, us);
+                                    std::uint32_t nv = path(v0, vs);
+                                    if (us[nu] == vs[nv]) {
+                                        const std::uint32_t min = nu < nv ? nu : nv;
+                                        for (nu -= min, nv -= min; us[nu] != vs[nv]; nu++, nv++)
+                                            ;
+                                        const std::uint32_t len = nu + nv + 1;
+                                        if (len == proofSize) {
+                                            found[id].push_back(found_cycle{
+                                                    std::uint64_t{from} << 32 | i, nu, nv,
+                                                    std::vector<std::uint32_t>(us, us + nu + 1),
+                                                    std::vector<std::uint32_t>(vs, vs + nv + 1)});
+                                        }
+                                    } else if (nu < nv) {
+                                        while (nu--)
+                                            cuckoo[us[nu + 1]] = us[nu];
+                                        cuckoo[u0] = v0;
+                                    } else {
+                                        while (nv--)
+                                            cuckoo[vs[nv + 1]] = vs[nv];
+                                        cuckoo[v0] = u0;
+                                    }
+                                }
+                            }
+                        }
+
+                        bool findcycles_parallel()
+                        {
+                            std::vector<std::future<void>> jobs;
+                            for (size_t t = 0; t < threads; t++) {
+                                jobs.push_back(
+                                        pool.push(
+                                            [this, t](int id) {
+                                                util::ScopedPin pinned{trimmer->cpus};
+                                                findworker<offset_t, EDGEBITS, XBITS>(this, t);
+                                            }));
+                            }
+
+                            for (auto& j : jobs) {
+                                j.wait();
+                            }
+                            if (trimmer->stale) {
+                                return false;
+                            }
+
+                            // recover the edges in the order the serial search
+                            // would have found the cycles
+                            std::vector<const found_cycle*> cycles;
+                            for (const auto& f : found) {
+                                for (const auto& c : f) {
+                                    cycles.push_back(&c);
+                                }
+                            }
+                            std::sort(cycles.begin(), cycles.end(),
+                                    [](const found_cycle* a, const found_cycle* b) { return a->order < b->order; });
+                            for (const auto* c : cycles) {
+                                solution(c->us.data(), c->nu, c->vs.data(), c->nv);
+                            }
+
+                            return !cycles.empty();
+                        }
+
+                        void* matchUnodes(match_state& m, std::uint32_t threadId, std::uint32_t nthreads)
+                        {
+                            const std::uint32_t starty = P::NY * threadId / nthreads;
+                            const std::uint32_t endy = P::NY * (threadId + 1) / nthreads;
+                            const std::uint32_t nodes = m.cycleus.size();
+
+                            std::uint32_t edge = starty << P::YZBITS;
+                            std::uint32_t endedge = edge + P::NYZ;
+
+#if NSIPHASH == 8
+                            static const __m256i vnodemask = {P::EDGEMASK, P::EDGEMASK, P::EDGEMASK, P::EDGEMASK};
+                            const __m256i vinit = _mm256_set_epi64x(
+                                    m.sip_keys.k1 ^ 0x7465646279746573ULL,
+                                    m.sip_keys.k0 ^ 0x6c7967656e657261ULL,
+                                    m.sip_keys.k1 ^ 0x646f72616e646f6dULL,
+                                    m.sip_keys.k0 ^ 0x736f6d6570736575ULL);
+                            __m256i v0, v1, v2, v3, v4, v5, v6, v7;
+                            const std::uint32_t e2 = 2 * edge;
+                            __m256i vpacket0 = _mm256_set_epi64x(e2 + 6, e2 + 4, e2 + 2, e2 + 0);
+                            __m256i vpacket1 = _mm256_set_epi64x(e2 + 14, e2 + 12, e2 + 10, e2 + 8);
+                            static const __m256i vpacketinc = {16, 16, 16, 16};
+#elif NSIPHASH == 16
+                            const __m512i vnodemask = _mm512_set1_epi64(P::EDGEMASK);
+                            const __m512i vinit0 = _mm512_set1_epi64(m.sip_keys.k0 ^ 0x736f6d6570736575ULL);
+                            const __m512i vinit1 = _mm512_set1_epi64(m.sip_keys.k1 ^ 0x646f72616e646f6dULL);
+                            const __m512i vinit2 = _mm512_set1_epi64(m.sip_keys.k0 ^ 0x6c7967656e657261ULL);
+                            const __m512i vinit3 = _mm512_set1_epi64(m.sip_keys.k1 ^ 0x7465646279746573ULL);
+                            const __m512i vff = _mm512_set1_epi64(0xff);
+                            __m512i v0, v1, v2, v3, v4, v5, v6, v7;
+                            const std::uint64_t e2 = 2 * edge;
+                            __m512i vpacket0 = _mm512_set_epi64(e2 + 14, e2 + 12, e2 + 10, e2 + 8, e2 + 6, e2 + 4, e2 + 2, e2 + 0);
+                            __m512i vpacket1 = _mm512_set_epi64(e2 + 30, e2 + 28, e2 + 26, e2 + 24, e2 + 22, e2 + 20, e2 + 18, e2 + 16);
+                            const __m512i vpacketinc = _mm512_set1_epi64(32);
+                            alignas(64) std::uint64_t uxys[NSIPHASH];
+                            alignas(64) std::uint64_t us[NSIPHASH];
+#endif
+
+                            for (std::uint32_t my = starty; my < endy; my++, endedge += P::NYZ) {
+                                for (; edge < endedge; edge += NSIPHASH) {
+                                    // bit        28..21     20..13    12..0
+                                    // node       XXXXXX     YYYYYY    ZZZZZ
+#if NSIPHASH == 1
+                                    const std::uint32_t nodeu = _sipnode(&m.sip_keys, P::EDGEMASK, edge, 0);
+                                    if (m.uxymap[nodeu >> P::ZBITS]) {
+                                        for (std::uint32_t j = 0; j < nodes; j++) {
+                                            if (m.cycleus[j] == nodeu && m.cyclevs[j] == _sipnode(&m.sip_keys, P::EDGEMASK, edge, 1)) {
+                                                m.sol[j] = edge;
+                                            }
+                                        }
+                                    }
+                                    // bit        39..21     20..13    12..0
+                                    // write        edge     YYYYYY    ZZZZZ
+#elif NSIPHASH == 8
+                                    v3 = _mm256_permute4x64_epi64(vinit, 0xFF);
+                                    v0 = _mm256_permute4x64_epi64(vinit, 0x00);
+                                    v1 = _mm256_permute4x64_epi64(vinit, 0x55);
+                                    v2 = _mm256_permute4x64_epi64(vinit, 0xAA);
+                                    v7 = _mm256_permute4x64_epi64(vinit, 0xFF);
+                                    v4 = _mm256_permute4x64_epi64(vinit, 0x00);
+                                    v5 = _mm256_permute4x64_epi64(vinit, 0x55);
+                                    v6 = _mm256_permute4x64_epi64(vinit, 0xAA);
+
+                                    v3 = XOR(v3, vpacket0);
+                                    v7 = XOR(v7, vpacket1);
+                                    SIPROUNDX8;
+                                    SIPROUNDX8;
+                                    v0 = XOR(v0, vpacket0);
+                                    v4 = XOR(v4, vpacket1);
+                                    v2 = XOR(v2, _mm256_broadcastq_epi64(_mm_cvtsi64_si128(0xff)));
+                                    v6 = XOR(v6, _mm256_broadcastq_epi64(_mm_cvtsi64_si128(0xff)));
+                                    SIPROUNDX8;
+                                    SIPROUNDX8;
+                                    SIPROUNDX8;
+                                    SIPROUNDX8;
+                                    v0 = XOR(XOR(v0, v1), XOR(v2, v3));
+                                    v4 = XOR(XOR(v4, v5), XOR(v6, v7));
+
+                                    vpacket0 = _mm256_add_epi64(vpacket0, vpacketinc);
+                                    vpacket1 = _mm256_add_epi64(vpacket1, vpacketinc);
+                                    v0 = v0 & vnodemask;
+                                    v4 = v4 & vnodemask;
+                                    v1 = _mm256_srli_epi64(v0, P::ZBITS);
+                                    v5 = _mm256_srli_epi64(v4, P::ZBITS);
+
+                                    std::uint32_t uxy;
+#define MATCH(i, v, x, w)                                                                                  \
+                                    uxy = _mm256_extract_epi32(v, x);                                                                      \
+                                    if (m.uxymap[uxy]) {                                                                                     \
+                                        std::uint32_t u = _mm256_extract_epi32(w, x);                                                           \
+                                        for (std::uint32_t j = 0; j < nodes; j++) {                                                             \
+                                            if (m.cycleus[j] == u && m.cyclevs[j] == _sipnode(&m.sip_keys, P::EDGEMASK, edge + i, 1)) { \
+                                                m.sol[j] = edge + i;                                              \
+                                            }                                                                                              \
+                                        }                                                                                                  \
+                                    }
+                                    MATCH(0, v1, 0, v0);
+                                    MATCH(1, v1, 2, v0);
+                                    MATCH(2, v1, 4, v0);
+                                    MATCH(3, v1, 6, v0);
+                                    MATCH(4, v5, 0, v4);
+                                    MATCH(5, v5, 2, v4);
+                                    MATCH(6, v5, 4, v4);
+                                    MATCH(7, v5, 6, v4);
+#elif NSIPHASH == 16
+                                    v0 = vinit0;
+                                    v1 = vinit1;
+                                    v2 = vinit2;
+                                    v3 = vinit3;
+                                    v4 = vinit0;
+                                    v5 = vinit1;
+                                    v6 = vinit2;
+                                    v7 = vinit3;
+
+                                    v3 = XOR16(v3, vpacket0);
+                                    v7 = XOR16(v7, vpacket1);
+                                    SIPROUNDX16;
+                                    SIPROUNDX16;
+                                    v0 = XOR16(v0, vpacket0);
+                                    v4 = XOR16(v4, vpacket1);
+                                    v2 = XOR16(v2, vff);
+                                    v6 = XOR16(v6, vff);
+                                    SIPROUNDX16;
+                                    SIPROUNDX16;
+                                    SIPROUNDX16;
+                                    SIPROUNDX16;
+                                    v0 = XOR16(XOR16(v0, v1), XOR16(v2, v3));
+                                    v4 = XOR16(XOR16(v4, v5), XOR16(v6, v7));
+
+                                    vpacket0 = ADD16(vpacket0, vpacketinc);
+                                    vpacket1 = ADD16(vpacket1, vpacketinc);
+                                    v0 = v0 & vnodemask;
+                                    v4 = v4 & vnodemask;
+                                    _mm512_store_si512((__m512i*)us, v0);
+                                    _mm512_store_si512((__m512i*)(us + 8), v4);
+                                    _mm512_store_si512((__m512i*)uxys, _mm512_srli_epi64(v0, P::ZBITS));
+                                    _mm512_store_si512((__m512i*)(uxys + 8), _mm512_srli_epi64(v4, P::ZBITS));
+
+                                    for (std::uint32_t i = 0; i < NSIPHASH; i++) {
+                                        if (m.uxymap[uxys[i]]) {
+                                            const std::uint32_t u = us[i];
+                                            for (std::uint32_t j = 0; j < nodes; j++) {
+                                                if (m.cycleus[j] == u && m.cyclevs[j] == _sipnode(&m.sip_keys, P::EDGEMASK, edge + i, 1)) {
+                                                    m.sol[j] = edge + i;
+                                                }
+                                            }
+                                        }
+                                    }
+#else
+#error not implemented
+#endif
+                                }
+                            }
+
+                            return 0;
+                        }
+                };
+
+            template <typename offset_t, std::uint8_t EDGEBITS, std::uint8_t XBITS>
+                std::unique_ptr<solver_base> make(
+                        std::uint8_t proofSize,
+                        size_t threads,
+                        ctpl::thread_pool& pool,
+                        const SolverOptions& options)
+                {
+                    static_assert(EDGEBITS >= MIN_EDGE_BITS && EDGEBITS <= MAX_EDGE_BITS, "unsupported edge bits");
+
+                    std::uint32_t nTrims = EDGEBITS >= 30 ? 96 : 68;
+
+                    return std::unique_ptr<solver_base>{
+                        new solver_ctx<offset_t, EDGEBITS, XBITS>{pool, threads, nTrims, proofSize, options}};
+                }
+
+            struct maker
+            {
+                std::uint8_t proofSize;
+                size_t threads;
+                ctpl::thread_pool& pool;
+                const SolverOptions& options;
+
+                template <typename offset_t, std::uint8_t EDGEBITS, std::uint8_t XBITS>
+                    std::unique_ptr<solver_base> apply() const
+                    {
+                        return make<offset_t, EDGEBITS, XBITS>(proofSize, threads, pool, options);
+                    }
+            };
+
+            std::unique_ptr<solver_base> make_solver(
+                    std::uint8_t edgeBits,
+                    std::uint8_t proofSize,
+                    size_t threads,
+                    ctpl::thread_pool& pool,
+                    const SolverOptions& options)
+            {
+                return with_params<std::unique_ptr<solver_base>>(edgeBits, maker{proofSize, threads, pool, options});
+            }
+        } // namespace MERIT_CUCKOO_ISA
+    } // namespace cuckoo
+} // namespace merit
+
+#undef STORE
+#undef MATCH
+#undef NSIPHASH
+#undef MERIT_CUCKOO_ISA
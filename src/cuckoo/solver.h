@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#ifndef MERIT_CUCKOO_SOLVER_H
+#define MERIT_CUCKOO_SOLVER_H
+
+#include "merit/cuckoo/mean_cuckoo.h"
+#include "merit/crypto/siphash.h"
+#include "merit/util/cancel.hpp"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace merit
+{
+    namespace cuckoo
+    {
+        const int MAXPATHLEN = 8192;
+        /** Minimum number of edge bits for cuckoo miner - block.nEdgeBits value */
+        const std::uint16_t MIN_EDGE_BITS = 16;
+        /** Maximum number of edge bits for cuckoo miner - block.nEdgeBits value */
+        const std::uint16_t MAX_EDGE_BITS = 31;
+
+        // type erased interface to a solver engine so the Solver can keep
+        // one alive between attempts.
+        class solver_base
+        {
+            public:
+                virtual ~solver_base() {}
+
+                bool find_cycles(
+                        const char* header,
+                        const std::uint32_t headerlen,
+                        Cycles& cycles,
+                        const util::CancelToken& cancel);
+
+                // solves the graph of keys already derived from a header
+                virtual bool find_cycles(
+                        const crypto::siphash_keys& keys,
+                        Cycles& cycles,
+                        const util::CancelToken& cancel) = 0;
+
+                virtual util::PageBacking page_backing() const = 0;
+
+                // trimming rounds the last graph took, one per side trimmed
+                virtual std::uint32_t trim_rounds() const = 0;
+
+                // whether the last graph was given up on when its token
+                // was cancelled
+                virtual bool aborted() const = 0;
+
+                virtual const GraphTelemetry* telemetry() const
+                {
+                    return nullptr;
+                }
+
+                // Engines that can't overlap cycle finding with the next
+                // graph solve right away and return a ready future.
+                virtual std::shared_future<Cycles> find_cycles_async(
+                        const char* header,
+                        const std::uint32_t headerlen,
+                        const util::CancelToken& cancel)
+                {
+                    std::promise<Cycles> result;
+                    Cycles cycles;
+                    find_cycles(header, headerlen, cycles, cancel);
+                    result.set_value(cycles);
+                    return result.get_future().share();
+                }
+        };
+
+        using EdgeIndices = std::vector<std::uint32_t>;
+
+        // Walks the cuckoo forest over edges given as full node ids, u's
+        // even and v's odd, in order. Returns every proofSize cycle as
+        // indices into unodes/vnodes.
+        std::vector<EdgeIndices> find_cycle_indices(
+                const std::vector<std::uint32_t>& unodes,
+                const std::vector<std::uint32_t>& vnodes,
+                const std::uint8_t proofSize);
+
+        // convenience function for extracting siphash keys from header
+        void setHeader(const char* header, const std::uint32_t headerlen, crypto::siphash_keys* keys);
+
+        // the same for n headers of headerlen bytes, such as the
+        // consecutive nonces of a batch. four at a time with avx2.
+        void setHeaders(const char* const* headers, const std::uint32_t headerlen, size_t n, crypto::siphash_keys* keys);
+
+        std::unique_ptr<solver_base> make_lean_solver(
+                std::uint8_t edgeBits,
+                std::uint8_t proofSize,
+                size_t threads,
+                ctpl::thread_pool& pool,
+                const SolverOptions& options);
+    }
+}
+
+#endif // MERIT_CUCKOO_SOLVER_H
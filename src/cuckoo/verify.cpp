@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/cuckoo/verify.h"
+#include "solver.h"
+#include "merit/crypto/siphash.h"
+#include "merit/crypto/siphashxN.h"
+#include "merit/blake2/blake2.h"
+#include "merit/util/cpu.hpp"
+
+#include <algorithm>
+#include <array>
+
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define MERIT_VERIFY_DISPATCH 1
+#endif
+
+namespace merit
+{
+    namespace cuckoo
+    {
+        namespace
+        {
+            // both endpoints of every edge, padded to whole siphash batches
+            const size_t MAX_NODES = 2 * MAX_PROOF_SIZE;
+
+            using Nonces = std::array<std::uint64_t, MAX_NODES>;
+
+            void sipnodes_scalar(
+                    const crypto::siphash_keys& keys,
+                    std::uint64_t mask,
+                    const Nonces& nonces,
+                    Nonces& nodes,
+                    size_t n)
+            {
+                for(size_t i = 0; i < n; i++) {
+                    nodes[i] = crypto::siphash24(&keys, nonces[i]) & mask;
+                }
+            }
+
+#if defined(MERIT_VERIFY_DISPATCH) || defined(__AVX2__)
+#ifdef MERIT_VERIFY_DISPATCH
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+            void sipnodes_avx2(
+                    const crypto::siphash_keys& keys,
+                    std::uint64_t mask,
+                    const Nonces& nonces,
+                    Nonces& nodes,
+                    size_t n)
+            {
+                const __m256i vinit0 = _mm256_set1_epi64x(keys.k0 ^ 0x736f6d6570736575ULL);
+                const __m256i vinit1 = _mm256_set1_epi64x(keys.k1 ^ 0x646f72616e646f6dULL);
+                const __m256i vinit2 = _mm256_set1_epi64x(keys.k0 ^ 0x6c7967656e657261ULL);
+                const __m256i vinit3 = _mm256_set1_epi64x(keys.k1 ^ 0x7465646279746573ULL);
+                const __m256i vff = _mm256_set1_epi64x(0xff);
+                const __m256i vmask = _mm256_set1_epi64x(mask);
+                __m256i v0, v1, v2, v3, v4, v5, v6, v7;
+
+                for(size_t i = 0; i < n; i += 8) {
+                    const __m256i vpacket0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&nonces[i]));
+                    const __m256i vpacket1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&nonces[i + 4]));
+
+                    v0 = v4 = vinit0;
+                    v1 = v5 = vinit1;
+                    v2 = v6 = vinit2;
+                    v3 = XOR(vinit3, vpacket0);
+                    v7 = XOR(vinit3, vpacket1);
+                    SIPROUNDX8;
+                    SIPROUNDX8;
+                    v0 = XOR(v0, vpacket0);
+                    v4 = XOR(v4, vpacket1);
+                    v2 = XOR(v2, vff);
+                    v6 = XOR(v6, vff);
+                    SIPROUNDX8;
+                    SIPROUNDX8;
+                    SIPROUNDX8;
+                    SIPROUNDX8;
+                    v0 = XOR(XOR(v0, v1), XOR(v2, v3));
+                    v4 = XOR(XOR(v4, v5), XOR(v6, v7));
+
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&nodes[i]), _mm256_and_si256(v0, vmask));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&nodes[i + 4]), _mm256_and_si256(v4, vmask));
+                }
+            }
+#ifdef MERIT_VERIFY_DISPATCH
+#pragma GCC pop_options
+#endif
+#define MERIT_VERIFY_AVX2 1
+#endif
+
+            bool use_avx2()
+            {
+#if defined(MERIT_VERIFY_DISPATCH)
+                static const bool avx2 = util::detect_isa() >= util::Isa::AVX2;
+                return avx2;
+#elif defined(MERIT_VERIFY_AVX2)
+                return true;
+#else
+                return false;
+#endif
+            }
+        }
+
+        const char* to_string(CycleStatus s)
+        {
+            switch(s) {
+                case CycleStatus::Ok: return "ok";
+                case CycleStatus::WrongSize: return "wrong size";
+                case CycleStatus::EdgeTooBig: return "edge too big";
+                case CycleStatus::NotAscending: return "edges not ascending";
+                case CycleStatus::NonMatching: return "endpoints not matching up";
+                case CycleStatus::Branch: return "branch in cycle";
+                case CycleStatus::DeadEnd: return "cycle dead ends";
+                case CycleStatus::ShortCycle: return "cycle too short";
+            }
+            return "unknown";
+        }
+
+        CycleStatus verify_cycle(
+                const char* hex_header_hash,
+                uint32_t hex_header_hash_len,
+                uint8_t edgeBits,
+                const uint32_t* edges,
+                uint8_t proofSize)
+        {
+            if(proofSize == 0 || proofSize > MAX_PROOF_SIZE || edgeBits > 32) {
+                return CycleStatus::WrongSize;
+            }
+
+            const std::uint64_t edgemask = (1ULL << edgeBits) - 1;
+
+            // u endpoints are at even indices and v endpoints at odd ones
+            Nonces nonces;
+            for(uint32_t n = 0; n < proofSize; n++) {
+                if(edges[n] > edgemask) {
+                    return CycleStatus::EdgeTooBig;
+                }
+                if(n && edges[n] <= edges[n - 1]) {
+                    return CycleStatus::NotAscending;
+                }
+                nonces[2 * n] = 2 * static_cast<std::uint64_t>(edges[n]);
+                nonces[2 * n + 1] = 2 * static_cast<std::uint64_t>(edges[n]) + 1;
+            }
+
+            crypto::siphash_keys keys;
+            setHeader(hex_header_hash, hex_header_hash_len, &keys);
+
+            const size_t nodes_len = 2 * proofSize;
+            Nonces uvs;
+#ifdef MERIT_VERIFY_AVX2
+            if(use_avx2()) {
+                const size_t padded = (nodes_len + 7) & ~size_t{7};
+                std::fill(nonces.begin() + nodes_len, nonces.begin() + padded, 0);
+                sipnodes_avx2(keys, edgemask, nonces, uvs, padded);
+            } else {
+                sipnodes_scalar(keys, edgemask, nonces, uvs, nodes_len);
+            }
+#else
+            sipnodes_scalar(keys, edgemask, nonces, uvs, nodes_len);
+#endif
+
+            std::uint64_t xor0 = 0;
+            std::uint64_t xor1 = 0;
+            for(size_t n = 0; n < proofSize; n++) {
+                xor0 ^= uvs[2 * n];
+                xor1 ^= uvs[2 * n + 1];
+            }
+            if(xor0 | xor1) {
+                return CycleStatus::NonMatching;
+            }
+
+            // walk the cycle, every endpoint has to be shared with exactly
+            // one other edge on the same side
+            size_t n = 0;
+            size_t i = 0;
+            do {
+                size_t j = i;
+                for(size_t k = (i + 2) % nodes_len; k != i; k = (k + 2) % nodes_len) {
+                    if(uvs[k] == uvs[i]) {
+                        if(j != i) {
+                            return CycleStatus::Branch;
+                        }
+                        j = k;
+                    }
+                }
+                if(j == i) {
+                    return CycleStatus::DeadEnd;
+                }
+                i = j ^ 1;
+                n++;
+            } while(i != 0);
+
+            return n == proofSize ? CycleStatus::Ok : CycleStatus::ShortCycle;
+        }
+
+        CycleStatus verify_cycle(
+                const char* hex_header_hash,
+                uint32_t hex_header_hash_len,
+                uint8_t edgeBits,
+                uint8_t proofSize,
+                const Cycle& cycle)
+        {
+            if(cycle.size() != proofSize || proofSize > MAX_PROOF_SIZE) {
+                return CycleStatus::WrongSize;
+            }
+
+            std::array<uint32_t, MAX_PROOF_SIZE> edges;
+            std::copy(cycle.begin(), cycle.end(), edges.begin());
+            return verify_cycle(hex_header_hash, hex_header_hash_len, edgeBits, edges.data(), proofSize);
+        }
+    }
+}
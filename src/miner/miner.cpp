@@ -30,10 +30,13 @@
  */
 #include "merit/miner/miner.hpp"
 #include "merit/cuckoo/mean_cuckoo.h"
+#include "merit/cuckoo/verify.h"
+#include "merit/util/sha256.hpp"
 #include "merit/crypto/siphash.h"
-#include "merit/blake2/blake2.h"
+#include "merit/crypto/blake2b.h"
 #include "merit/termcolor/termcolor.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <set>
@@ -83,6 +86,10 @@ namespace merit
             const int CUCKOO_PROOF_SIZE = 42;
             const int MAX_STATS = 100;
 
+            // nonces a worker takes at a time, small enough that the workers
+            // finish a job's last range at about the same time
+            const std::uint32_t NONCE_LEASE = 256;
+
             bool work_same(const util::Work& a, const util::Work& b)
             {
                 return std::equal(
@@ -90,6 +97,62 @@ namespace merit
                         a.data.begin()+19,
                         b.data.begin());
             }
+
+            using HeaderHash = std::array<char, 64>;
+
+            // the 81 byte big endian header the graph is keyed with is
+            // hashed from the job's midstate, which covers the first 64
+            // bytes, and the 17 bytes holding the nonce
+            using HeaderTail = std::array<uint32_t, 5>;
+            const size_t HEADER_TAIL_SIZE = 81 - 64;
+
+            void header_tail(const util::Work& work, HeaderTail& tail)
+            {
+                for(int i = 0; i < tail.size(); i++) {
+                    be32enc(&tail[i], work.data[16 + i]);
+                }
+            }
+
+            void to_header_hex(const unsigned char* hash, HeaderHash& hex)
+            {
+                const char* digits = "0123456789abcdef";
+                for(int i = 0; i < 32; i++) {
+                    const auto b = hash[31 - i];
+                    hex[i * 2] = digits[b >> 4];
+                    hex[i * 2 + 1] = digits[b & 0xf];
+                }
+            }
+
+            // hex of the header's double sha256
+            void header_hash(const util::Work& work, HeaderHash& hex)
+            {
+                HeaderTail tail;
+                header_tail(work, tail);
+
+                std::array<unsigned char, 32> hash;
+                util::double_sha256(
+                        hash.data(),
+                        work.midstate,
+                        reinterpret_cast<const unsigned char*>(tail.data()),
+                        HEADER_TAIL_SIZE);
+                to_header_hex(hash.data(), hex);
+            }
+
+            // the pool has to fit the largest layout the miner may switch to
+            int pool_size(
+                    int workers,
+                    int threads_per_worker,
+                    int gpu_devices,
+                    const Options& options)
+            {
+                const int per_worker = options.pipeline ? 2 : 1;
+                int size = workers * (threads_per_worker + per_worker);
+                for(const auto& p : options.profile) {
+                    const auto& l = p.second;
+                    size = std::max(size, l.workers * (l.threads_per_worker + per_worker));
+                }
+                return size + gpu_devices;
+            }
         }
 
         int GpuDevices()
@@ -113,6 +176,7 @@ namespace merit
             attempts = 0;
             cycles = 0;
             shares = 0;
+            aborted = 0;
         }
 
         Stat::Stat(const Stat& o) :
@@ -122,9 +186,11 @@ namespace merit
             int a = o.attempts;
             int c = o.cycles;
             int s = o.shares;
+            int x = o.aborted;
             attempts = a;
             cycles = c;
             shares = s;
+            aborted = x;
         }
 
         Stat& Stat::operator=(const Stat& o)
@@ -133,9 +199,11 @@ namespace merit
             int a = o.attempts;
             int c = o.cycles;
             int s = o.shares;
+            int x = o.aborted;
             attempts = a;
             cycles = c;
             shares = s;
+            aborted = x;
             return *this;
         }
 
@@ -165,29 +233,193 @@ namespace merit
             return s == 0 ? 0 : h / s;
         }
 
+        double NodeStat::attempts_per_second() const
+        {
+            const double a = attempts;
+            return seconds == 0 ? 0 : a / seconds;
+        }
+
         Miner::Miner(
                 int workers,
                 int threads_per_worker,
                 const std::vector<int>& gpu_devices,
-                util::SubmitWorkFunc submit_work) :
+                util::SubmitWorkFunc submit_work,
+                const Options& options) :
+            _options{options},
             _submit_work{submit_work},
-            _pool{static_cast<int>((workers * threads_per_worker) + workers + gpu_devices.size())}
+            _gpu_devices{gpu_devices},
+            _pool{pool_size(workers, threads_per_worker, gpu_devices.size(), options)},
+            _nonces{NONCE_LEASE, options.max_ntime_roll}
         {
             assert(workers >= 0);
             assert(threads_per_worker >= 0);
 
             _state = NotRunning;
+            _epoch = 0;
+            _work_version = 0;
             std::cout << "info :: workers: " << termcolor::cyan << workers << termcolor::reset << std::endl;
             std::cout << "info :: threads per worker: " << termcolor::cyan << threads_per_worker << termcolor::reset << std::endl;
             std::cout << "info :: gpu devices: " << termcolor::cyan << gpu_devices.size() << termcolor::reset << std::endl;
+            std::cout << "info :: requested pages: " << termcolor::cyan << util::to_string(_options.solver.pages) << termcolor::reset << std::endl;
+
+            const auto requested_isa = _options.solver.isa;
+            _options.solver.isa = cuckoo::select_isa(requested_isa);
+            std::cout << "info :: solver isa: " << termcolor::cyan << util::to_string(_options.solver.isa) << termcolor::reset;
+            if(requested_isa != util::Isa::Auto && requested_isa != _options.solver.isa) {
+                std::cout << termcolor::yellow << " (" << util::to_string(requested_isa) << " not supported)" << termcolor::reset;
+            }
+            std::cout << std::endl;
+
+            std::cout << "info :: solver: " << termcolor::cyan << cuckoo::to_string(_options.solver.engine) << termcolor::reset;
+            if(_options.solver.memory_budget > 0) {
+                std::cout << " memory budget: " << termcolor::cyan << (_options.solver.memory_budget >> 20) << "MB" << termcolor::reset;
+            }
+            std::cout << std::endl;
+
+            if(_options.solver.trim_stop_rate > 0) {
+                std::cout << "info :: trim stop rate: " << termcolor::cyan << _options.solver.trim_stop_rate << termcolor::reset << std::endl;
+            }
+
+            if(_options.batch_edgebits > 0) {
+                std::cout << "info :: batched below edgebits: " << termcolor::cyan << _options.batch_edgebits << termcolor::reset << std::endl;
+            }
+
+            std::cout << "info :: sha256: " << termcolor::cyan << util::to_string(util::sha256_impl()) << termcolor::reset;
+            if(util::sha256_batch_impl() != util::sha256_impl()) {
+                std::cout << " batches: " << termcolor::cyan << util::to_string(util::sha256_batch_impl()) << termcolor::reset;
+            }
+            std::cout << " blake2b: " << termcolor::cyan << crypto::to_string(crypto::blake2b_impl()) << termcolor::reset << std::endl;
+
+            if(_options.solver.streaming_stores) {
+                std::cout << "info :: streaming stores: " << termcolor::cyan << "on" << termcolor::reset << std::endl;
+            }
+
+            if(_options.solver.telemetry) {
+                std::cout << "info :: solver telemetry: " << termcolor::cyan << "on" << termcolor::reset << std::endl;
+            }
+
+            if(_options.pipeline) {
+                std::cout << "info :: pipelined cycle finding: " << termcolor::cyan << "on" << termcolor::reset << std::endl;
+            }
+
+            if(!_options.profile.empty()) {
+                std::cout << "info :: profiled edgebits: " << termcolor::cyan << _options.profile.size() << termcolor::reset << std::endl;
+            }
+
+            if(_options.memory_limit > 0) {
+                std::cout << "info :: memory limit: " << termcolor::cyan << (_options.memory_limit >> 20) << "MB" << termcolor::reset << std::endl;
+            }
+
+            if(_options.max_ntime_roll > 0) {
+                std::cout << "info :: ntime roll: " << termcolor::cyan << _options.max_ntime_roll << "s" << termcolor::reset << std::endl;
+            }
+
+            if(_options.numa) {
+                _nodes = util::numa_nodes();
+                std::cout << "info :: numa nodes: " << termcolor::cyan << _nodes.size() << termcolor::reset << std::endl;
+            }
+
+            if(_options.pin_caches) {
+                _domains = util::cache_domains();
+                std::cout << "info :: cache domains: " << termcolor::cyan << _domains.size() << termcolor::reset
+                    << " smt: " << termcolor::cyan << util::to_string(_options.smt) << termcolor::reset << std::endl;
+            }
+
+            add_workers(workers, threads_per_worker);
+            _wanted_layout = _layout;
+            _next_layout = _layout;
+        }
+
+        void Miner::add_workers(int workers, int threads_per_worker)
+        {
+            _workers.clear();
+            _layout.workers = workers;
+            _layout.threads_per_worker = threads_per_worker;
+
+            std::vector<util::CpuSet> cpus(workers);
+            if(!_domains.empty()) {
+                cpus = util::assign_cpus(_domains, workers, threads_per_worker, _options.smt);
+            }
 
             for(int i = 0; i < workers; i++) {
-                _workers.emplace_back(i, threads_per_worker, false, _pool, *this);
+                int node = _nodes.empty() ? -1 : _nodes[i % _nodes.size()].id;
+                if(!_nodes.empty() && !cpus[i].empty()) {
+                    // the node holding the worker's first cpu
+                    for(const auto& n : _nodes) {
+                        if(std::find(n.cpus.begin(), n.cpus.end(), cpus[i].front()) != n.cpus.end()) {
+                            node = n.id;
+                        }
+                    }
+                }
+                _workers.emplace_back(i, threads_per_worker, false, node, cpus[i], _pool, *this);
+            }
+
+            for(int i = 0; i < _gpu_devices.size(); i++) {
+                _workers.emplace_back(_gpu_devices[i], threads_per_worker, true, -1, util::CpuSet{}, _pool, *this);
+            }
+        }
+
+        void Miner::relayout(int edgebits)
+        {
+            Layout l;
+            {
+                std::lock_guard<std::mutex> guard{_workers_mutex};
+                const auto profiled = _options.profile.find(edgebits);
+                if(profiled != _options.profile.end()) {
+                    _wanted_layout = profiled->second;
+                }
+
+                l = admit(_wanted_layout, edgebits);
+                if(l.workers == _next_layout.workers && l.threads_per_worker == _next_layout.threads_per_worker) {
+                    return;
+                }
+                _next_layout = l;
+            }
+
+            if(l.workers == 0) {
+                std::cerr << termcolor::red << "error :: edgebits " << edgebits << " graphs don't fit the memory limit, cpu workers parked" << termcolor::reset << std::endl;
+            } else if(l.workers != _wanted_layout.workers || l.threads_per_worker != _wanted_layout.threads_per_worker) {
+                std::cout << "info :: edgebits " << edgebits << " memory limited layout: "
+                    << termcolor::cyan << l.workers << " x " << l.threads_per_worker << termcolor::reset << std::endl;
+            } else {
+                std::cout << "info :: edgebits " << edgebits << " layout: "
+                    << termcolor::cyan << l.workers << " x " << l.threads_per_worker << termcolor::reset << std::endl;
+            }
+
+            // workers stop at their next graph and run() restarts them. a
+            // miner not running yet starts with the layout.
+            auto running = Running;
+            if(_state.compare_exchange_strong(running, Reconfiguring)) {
+                wake_workers();
+            }
+        }
+
+        Layout Miner::admit(Layout l, int edgebits) const
+        {
+            if(_options.memory_limit == 0 || l.workers == 0) {
+                return l;
             }
 
-            for(int i = 0; i < gpu_devices.size(); i++) {
-                _workers.emplace_back(gpu_devices[i], threads_per_worker, true, _pool, *this);
+            // merge teams until their solvers fit. threads that don't
+            // divide evenly between the remaining workers are parked.
+            const int threads = l.workers * l.threads_per_worker;
+            try {
+                for(int w = l.workers; w > 0; w--) {
+                    const int t = threads / w;
+                    const bool batch = t > 1 && batched(edgebits);
+                    if(w * cuckoo::solver_bytes(_options.solver, edgebits, t, batch) <= _options.memory_limit) {
+                        l.workers = w;
+                        l.threads_per_worker = t;
+                        return l;
+                    }
+                }
+            } catch(std::exception&) {
+                // the solvers reject the edge bits themselves
+                return l;
             }
+
+            l.workers = 0;
+            return l;
         }
 
         Miner::~Miner()
@@ -200,12 +432,20 @@ namespace merit
 
         void Miner::submit_job(const stratum::Job& j)
         {
-            auto w = stratum::work_from_job(j);
-            util::MaybeWork prev_work;
-            {
-                std::lock_guard<std::mutex> guard{_work_mutex};
-                prev_work = _next_work;
-                _next_work = w;
+            auto w = std::make_shared<const util::Work>(stratum::work_from_job(j));
+
+            // before the work is published, so no worker of a layout that
+            // doesn't fit the job's graphs starts on it
+            relayout(w->data[20] >> 24);
+
+            // jobs are only published from this thread
+            const auto prev_work = next_work();
+            publish(w, &j);
+
+            // after the work is swapped, so a worker holding a token from
+            // before the bump can only have read the stale work
+            if(j.clean && prev_work && !work_same(*prev_work, *w)) {
+                _epoch++;
             }
 
             {
@@ -213,7 +453,7 @@ namespace merit
                 if(_total_stats.start == std::chrono::high_resolution_clock::time_point{}) {
                     _total_stats.start = std::chrono::high_resolution_clock::now();
                 } else {
-                    if(!_next_work || !prev_work || work_same(*prev_work, *_next_work)) {
+                    if(!prev_work || work_same(*prev_work, *w)) {
                         return;
                     }
 
@@ -225,6 +465,7 @@ namespace merit
                     _current_stat.attempts = 0;
                     _current_stat.cycles = 0;
                     _current_stat.shares = 0;
+                    _current_stat.aborted = 0;
 
                     _stats.push_back(current);
                     if(_stats.size() > MAX_STATS) {
@@ -236,16 +477,47 @@ namespace merit
                     const int a = current.attempts;
                     const int c = current.cycles;
                     const int s = current.shares;
+                    const int x = current.aborted;
 
                     _total_stats.attempts += a;
                     _total_stats.cycles += c;
                     _total_stats.shares += s;
+                    _total_stats.aborted += x;
                 }
             }
         }
 
         void Miner::clear_job() {
-            _next_work.reset();
+            if(next_work()) {
+                publish(nullptr, nullptr);
+            }
+        }
+
+        void Miner::publish(WorkSnapshot w, const stratum::Job* j)
+        {
+            {
+                std::lock_guard<std::mutex> guard{_work_mutex};
+                const auto version = _work_version + 1;
+                if(w) {
+                    assert(j);
+                    _nonces.reset(*j, w, version);
+                } else {
+                    _nonces.clear(version);
+                }
+                std::atomic_store(&_next_work, std::move(w));
+                _work_version = version;
+            }
+            _work_cv.notify_all();
+        }
+
+        void Miner::wake_workers()
+        {
+            // the empty lock orders the state change before any waiter's
+            // predicate check, so the notify can't be missed
+            {
+                std::lock_guard<std::mutex> guard{_work_mutex};
+            }
+            _work_cv.notify_all();
         }
 
         void Miner::submit_work(const util::Work& w)
@@ -263,18 +535,49 @@ namespace merit
 
             _state = Running;
 
-            for(auto& worker : _workers) {
-                _jobs.push_back(_pool.push(
-                            [&worker](int id){ 
-                                try {
-                                    worker.run(); 
-                                } catch( std::exception& e) {
-                                    std::cerr << termcolor::red << "mining worker " << id << " error: " << e.what() << termcolor::reset << std::endl;
-                                }
-                            }));
+            {
+                // a job submitted before the start may have picked a layout
+                std::lock_guard<std::mutex> guard{_workers_mutex};
+                if(_next_layout.workers != _layout.workers || _next_layout.threads_per_worker != _layout.threads_per_worker) {
+                    add_workers(_next_layout.workers, _next_layout.threads_per_worker);
+                }
             }
 
-            wait_for_jobs();
+            while(true) {
+                for(auto& worker : _workers) {
+                    _jobs.push_back(_pool.push(
+                                [&worker](int id){ 
+                                    try {
+                                        worker.run(); 
+                                    } catch( std::exception& e) {
+                                        std::cerr << termcolor::red << "mining worker " << id << " error: " << e.what() << termcolor::reset << std::endl;
+                                    }
+                                }));
+                }
+
+                // every worker is parked until a job's graphs fit
+                while(_jobs.empty() && _state == Running) {
+                    std::this_thread::sleep_for(100ms);
+                }
+
+                wait_for_jobs();
+                _jobs.clear();
+
+                if(_state != Reconfiguring) {
+                    break;
+                }
+
+                {
+                    std::lock_guard<std::mutex> guard{_workers_mutex};
+                    add_workers(_next_layout.workers, _next_layout.threads_per_worker);
+                }
+
+                // stop() may have come in while the workers were rebuilt
+                auto reconfiguring = Reconfiguring;
+                if(!_state.compare_exchange_strong(reconfiguring, Running)) {
+                    break;
+                }
+            }
             _state = NotRunning;
 
             std::cout << "info :: " << "stopped workers." << std::endl;
@@ -289,12 +592,35 @@ namespace merit
         {
             std::cout << "info :: " << "stopping workers..." << std::endl;
             _state = Stopping;
+            wake_workers();
         }
 
-        util::MaybeWork Miner::next_work() const
+        std::uint64_t Miner::work_version() const
         {
-            std::lock_guard<std::mutex> guard{_work_mutex};
-            return _next_work;
+            return _work_version;
+        }
+
+        WorkSnapshot Miner::next_work() const
+        {
+            return std::atomic_load(&_next_work);
+        }
+
+        void Miner::wait_for_work(std::uint64_t version, std::chrono::milliseconds timeout) const
+        {
+            std::unique_lock<std::mutex> guard{_work_mutex};
+            _work_cv.wait_for(guard, timeout, [this, version]() {
+                    return _work_version != version || _state != Running;
+            });
+        }
+
+        bool Miner::lease_nonces(NonceLease& lease)
+        {
+            return _nonces.lease(lease);
+        }
+
+        util::CancelToken Miner::cancel_token() const
+        {
+            return util::CancelToken{_epoch};
         }
 
         int Miner::total_workers() const
@@ -302,6 +628,96 @@ namespace merit
             return _workers.size();
         }
 
+        const Options& Miner::options() const
+        {
+            return _options;
+        }
+
+        bool Miner::batched(int edgebits) const
+        {
+            const auto profiled = _options.profile.find(edgebits);
+            if(profiled != _options.profile.end()) {
+                return profiled->second.batch;
+            }
+            return edgebits < _options.batch_edgebits;
+        }
+
+        const util::CpuSet& Miner::node_cpus(int node) const
+        {
+            auto n = std::find_if(_nodes.begin(), _nodes.end(),
+                    [node](const util::NumaNode& n) { return n.id == node; });
+            assert(n != _nodes.end());
+            return n->cpus;
+        }
+
+        NodeStats Miner::node_stats() const
+        {
+            NodeStats stats;
+            double seconds = 0;
+            {
+                std::lock_guard<std::mutex> sguard{_stat_mutex};
+                if(_total_stats.start != std::chrono::high_resolution_clock::time_point{}) {
+                    seconds = std::chrono::duration_cast<std::chrono::seconds>(
+                            std::chrono::high_resolution_clock::now() - _total_stats.start).count();
+                }
+            }
+
+            std::lock_guard<std::mutex> guard{_workers_mutex};
+            for(const auto& n : _nodes) {
+                NodeStat s{n.id, 0, 0, seconds};
+                for(const auto& w : _workers) {
+                    if(w.node() == n.id) {
+                        s.workers++;
+                        s.attempts += w.attempts();
+                    }
+                }
+                stats.push_back(s);
+            }
+            return stats;
+        }
+
+        void Miner::add_telemetry(int edgebits, const cuckoo::GraphTelemetry& t)
+        {
+            using ms = std::chrono::duration<double, std::milli>;
+
+            std::lock_guard<std::mutex> guard{_stage_mutex};
+            auto& s = _stage_stats[edgebits];
+            const size_t rounds = t.round_time.size();
+            if(s.round_ms.size() < rounds) {
+                s.round_ms.resize(rounds, 0);
+                s.round_edges.resize(rounds, 0);
+                s.round_graphs.resize(rounds, 0);
+            }
+
+            s.graphs++;
+            for(size_t r = 0; r < rounds; r++) {
+                s.round_ms[r] += ms{t.round_time[r]}.count();
+                s.round_edges[r] += t.round_edges[r];
+                s.round_graphs[r]++;
+            }
+            s.find_ms += ms{t.find_time}.count();
+            s.match_ms += ms{t.match_time}.count();
+        }
+
+        StageStats Miner::stage_stats() const
+        {
+            std::lock_guard<std::mutex> guard{_stage_mutex};
+            return _stage_stats;
+        }
+
+        MaybePageBacking Miner::page_backing() const
+        {
+            MaybePageBacking backing;
+            std::lock_guard<std::mutex> guard{_workers_mutex};
+            for(const auto& w : _workers) {
+                auto b = w.page_backing();
+                if(b && (!backing || *b < *backing)) {
+                    backing = b;
+                }
+            }
+            return backing;
+        }
+
         Miner::State Miner::state() const
         {
             return _state;
@@ -342,12 +758,18 @@ namespace merit
                 int id,
                 int threads,
                 bool gpu_device,
+                int node,
+                const util::CpuSet& cpus,
                 ctpl::thread_pool& pool,
                 Miner& miner) :
             _state{NotRunning},
+            _page_backing{-1},
+            _attempts{0},
             _id{id},
             _threads{threads},
             _gpu_device{gpu_device},
+            _node{node},
+            _cpus{cpus},
             _pool{pool},
             _miner{miner}
         {
@@ -357,11 +779,17 @@ namespace merit
             _id{o._id},
             _threads{o._threads},
             _gpu_device{o._gpu_device},
+            _node{o._node},
+            _cpus{o._cpus},
             _pool{o._pool},
             _miner{o._miner}
         {
             State s = o._state;
             _state = s;
+            int b = o._page_backing;
+            _page_backing = b;
+            int a = o._attempts;
+            _attempts = a;
         }
 
         int Worker::id()
@@ -369,6 +797,25 @@ namespace merit
             return _id;
         }
 
+        int Worker::node() const
+        {
+            return _node;
+        }
+
+        int Worker::attempts() const
+        {
+            return _attempts;
+        }
+
+        MaybePageBacking Worker::page_backing() const
+        {
+            const int b = _page_backing;
+            if(b < 0) {
+                return MaybePageBacking{};
+            }
+            return static_cast<util::PageBacking>(b);
+        }
+
         bool target_test(
                 const std::array<uint32_t, 8>& hash,
                 const std::array<uint32_t, 8>& target)
@@ -384,139 +831,282 @@ namespace merit
             return true;
         }
 
+        void Worker::found_cycles(util::Work& work, const Cycles& cycles, const util::CancelToken& cancel)
+        {
+            auto& stat = _miner.current_stat();
+
+            // a clean job came in while the graph was solved, its cycles
+            // could only be stale shares
+            if(cancel.cancelled()) {
+                stat.aborted++;
+                return;
+            }
+
+            stat.attempts++;
+            _attempts++;
+
+            if(!cycles.empty()) {
+                HeaderHash hex_header_hash;
+                header_hash(work, hex_header_hash);
+                const uint8_t edgebits = work.data[20] >> 24;
+
+                int idx = 0;
+                for(const auto& cycle: cycles) {
+                    // never submit a proof the pool would reject
+                    const auto status = cuckoo::verify_cycle(
+                            hex_header_hash.data(),
+                            hex_header_hash.size(),
+                            edgebits,
+                            CUCKOO_PROOF_SIZE,
+                            cycle);
+                    if(status != cuckoo::CycleStatus::Ok) {
+                        std::cerr << termcolor::red << "error :: (" << _id << ") dropped invalid cycle (" << idx << "): " << cuckoo::to_string(status) << termcolor::reset << std::endl;
+                        idx++;
+                        continue;
+                    }
+                    stat.cycles++;
+
+                    assert(cycle.size() == work.cycle.size());
+                    assert(work.cycle.size() == CUCKOO_PROOF_SIZE);
+
+                    std::copy(cycle.begin(), cycle.end(), work.cycle.begin());
+
+                    std::array<uint32_t, 8> cycle_hash;
+                    std::array<uint8_t, 1 + sizeof(uint32_t) * CUCKOO_PROOF_SIZE> cycle_with_size;
+                    cycle_with_size[0] = CUCKOO_PROOF_SIZE;
+                    std::copy(
+                            reinterpret_cast<const uint8_t*>(work.cycle.data()),
+                            reinterpret_cast<const uint8_t*>(work.cycle.data()) + sizeof(uint32_t) * work.cycle.size(),
+                            cycle_with_size.begin()+1);
+
+                    util::double_sha256(
+                            reinterpret_cast<unsigned char*>(cycle_hash.data()),
+                            cycle_with_size.data(),
+                            cycle_with_size.size());
+
+                    std::string cycle_hash_hex;
+                    util::to_hex(cycle_with_size, cycle_hash_hex);
+
+                    if(target_test(cycle_hash, work.target)) {
+                        std::cout << "info :: " << termcolor::green << "(" << _id << ") found share (" << idx << "): " << cycle_hash_hex << termcolor::reset << std::endl;
+                        stat.shares++;
+                        _miner.submit_work(work);
+                    } else {
+                        std::cout << "info :: " << termcolor::blue << "(" << _id << ") found cycle (" << idx << "): " << cycle_hash_hex << termcolor::reset << std::endl;
+                    }
+
+                    idx++;
+                }
+            }
+        }
+
         void Worker::run()
         {
             std::cout << "info :: " << "started worker: " << _id << std::endl;
             using namespace std::chrono_literals;
-            util::Work prev_work;
-            uint32_t n =  0xffffffffU / _miner.total_workers() * _id;
-            uint32_t end_nonce = 0xffffffffU / _miner.total_workers() * (_id + 1) - 0x20;
+            util::MaybeWork work;
+            WorkSnapshot held;
+            NonceLease lease;
+
+            // worker threads come from the shared pool, the pin is undone
+            // when the worker stops so the thread can serve other layouts
+            auto options = _miner.options().solver;
+            boost::optional<util::ScopedPin> pinned;
+            if(!_cpus.empty()) {
+                options.numa_node = _node;
+                options.cpus = _cpus;
+                pinned.emplace(options.cpus);
+                if(!pinned->pinned()) {
+                    std::cout << "info :: " << termcolor::yellow << "unable to pin worker " << _id << " to cpus " << util::to_cpu_list(_cpus) << termcolor::reset << std::endl;
+                } else {
+                    std::cout << "info :: " << "pinned worker " << _id << " to cpus " << util::to_cpu_list(_cpus) << std::endl;
+                }
+            } else if(_node >= 0) {
+                options.numa_node = _node;
+                options.cpus = _miner.node_cpus(_node);
+                pinned.emplace(options.cpus);
+                if(!pinned->pinned()) {
+                    std::cout << "info :: " << termcolor::yellow << "unable to pin worker " << _id << " to node " << _node << termcolor::reset << std::endl;
+                } else {
+                    std::cout << "info :: " << "pinned worker " << _id << " to node " << _node << std::endl;
+                }
+            }
+            const auto& engines = _miner.options().worker_engines;
+            if(_id < static_cast<int>(engines.size())) {
+                options.engine = engines[_id];
+            }
+            cuckoo::Solver solver{static_cast<size_t>(_threads), _pool, options};
+            auto engine = cuckoo::Engine::Auto;
+
+            const bool pipelined = _miner.options().pipeline && !_gpu_device;
+            std::shared_future<Cycles> pending;
+            util::Work pending_work;
+            util::CancelToken pending_cancel;
 
             _state = Running;
             while(_miner.state() == Miner::Running)
             {
-                auto work = _miner.next_work();
-
-                if(!work) {
-                    std::this_thread::sleep_for(10ms);
-                    continue;
+                auto cancel = _miner.cancel_token();
+
+                // a new job drops what is left of the lease, a header
+                // variant is only copied when the lease moves to it
+                if(lease.empty() || _miner.work_version() != lease.version) {
+                    if(!_miner.lease_nonces(lease)) {
+                        work = util::MaybeWork{};
+                        held = nullptr;
+                    } else if(lease.work != held) {
+                        held = lease.work;
+                        work = *held;
+                    }
                 }
 
-                if(work_same(prev_work, *work)) {
-                    work->data[19] = ++n;
-                } else {
-                    n =  0xffffffffU / _miner.total_workers() * _id;
-                    work->data[19] = n;
-                    prev_work = *work;
+                // the job may have come with a relayout this worker isn't part of
+                if(_miner.state() != Miner::Running) {
+                    break;
                 }
 
-                if(n > end_nonce) {
-                    std::this_thread::sleep_for(10ms);
+                if(!work || lease.empty()) {
+                    _miner.wait_for_work(lease.version, 100ms);
                     continue;
                 }
 
-                assert(work->data.size() > 16);
+                work->data[19] = static_cast<uint32_t>(lease.next++);
 
-                auto bwork = work->data;
-                for(int i = 0; i < bwork.size(); i++) {
-                    be32enc(&bwork[i], work->data[i]);
-                }
+                uint8_t edgebits = work->data[20] >> 24;
 
-                std::array<unsigned char, 32> hash;
-                util::double_sha256(
-                        hash.data(),
-                        reinterpret_cast<const unsigned char*>(bwork.data()),
-                        81);
-                std::reverse(hash.begin(), hash.end());
+                const bool batched = !_gpu_device && _threads > 1 && _miner.batched(edgebits);
 
-                std::string hex_header_hash;
-                util::to_hex(hash, hex_header_hash);
+                HeaderHash hex_header_hash;
+                if(!batched) {
+                    header_hash(*work, hex_header_hash);
+                }
 
                 uint8_t proofsize = 42;
                 Cycles cycles;
+                bool solved = true;
 
-                uint8_t edgebits = work->data[20] >> 24;
+                if(batched) {
+                    // small graphs, solve consecutive nonces one per thread
+                    if(pending.valid()) {
+                        found_cycles(pending_work, pending.get(), pending_cancel);
+                        pending = {};
+                    }
 
-#if CUDA_ENABLED
-                bool found = false;
-                if(!_gpu_device) {
-                    found = cuckoo::FindCycles(
+                    std::vector<util::Work> batch;
+                    std::vector<HeaderTail> tails;
+                    for(;;) {
+                        batch.push_back(*work);
+                        tails.emplace_back();
+                        header_tail(*work, tails.back());
+                        if(batch.size() == static_cast<size_t>(_threads) || lease.empty()) {
+                            break;
+                        }
+                        work->data[19] = static_cast<uint32_t>(lease.next++);
+                    }
+
+                    // the headers only differ in the nonce, they are hashed
+                    // together from the midstate
+                    std::vector<unsigned char> hashes(tails.size() * 32);
+                    util::double_sha256_batch(
+                            hashes.data(),
+                            work->midstate,
+                            reinterpret_cast<const unsigned char*>(tails.data()),
+                            HEADER_TAIL_SIZE,
+                            sizeof(HeaderTail),
+                            tails.size());
+
+                    std::vector<std::string> headers;
+                    for(size_t i = 0; i < tails.size(); i++) {
+                        to_header_hex(&hashes[i * 32], hex_header_hash);
+                        headers.emplace_back(hex_header_hash.begin(), hex_header_hash.end());
+                    }
+
+                    std::vector<Cycles> batch_cycles;
+                    solver.find_cycles_batch(headers, edgebits, CUCKOO_PROOF_SIZE, batch_cycles, cancel);
+                    for(size_t i = 0; i < batch.size(); i++) {
+                        found_cycles(batch[i], batch_cycles[i], cancel);
+                    }
+                    solved = false;
+                } else if(pipelined) {
+                    // start on this graph and account for the previous one,
+                    // whose cycles were searched while this one was trimmed
+                    auto next = solver.find_cycles_async(
                             hex_header_hash.data(),
                             hex_header_hash.size(),
                             edgebits,
                             CUCKOO_PROOF_SIZE,
-                            cycles,
-                            _threads,
-                            _pool);
+                            cancel);
+
+                    if(pending.valid()) {
+                        found_cycles(pending_work, pending.get(), pending_cancel);
+                    }
+                    pending = std::move(next);
+                    pending_work = *work;
+                    pending_cancel = cancel;
+                    solved = false;
                 } else {
-                    crypto::siphash_keys keys;
-                    char hdrkey[32];
-                    blake2b(
-                            reinterpret_cast<void*>(hdrkey),
-                            sizeof(hdrkey),
-                            reinterpret_cast<const void*>(hex_header_hash.data()),
-                            hex_header_hash.size(), 0, 0);
-                    crypto::setkeys(&keys, hdrkey);
-
-                    found = FindCyclesOnCudaDevice(
-                            keys.k0, keys.k1,
+#if CUDA_ENABLED
+                    if(!_gpu_device) {
+                        solver.find_cycles(
+                                hex_header_hash.data(),
+                                hex_header_hash.size(),
+                                edgebits,
+                                CUCKOO_PROOF_SIZE,
+                                cycles,
+                                cancel);
+                    } else {
+                        crypto::siphash_keys keys;
+                        char hdrkey[32];
+                        crypto::blake2b(
+                                reinterpret_cast<unsigned char*>(hdrkey),
+                                sizeof(hdrkey),
+                                reinterpret_cast<const unsigned char*>(hex_header_hash.data()),
+                                hex_header_hash.size());
+                        crypto::setkeys(&keys, hdrkey);
+
+                        FindCyclesOnCudaDevice(
+                                keys.k0, keys.k1,
+                                edgebits,
+                                CUCKOO_PROOF_SIZE,
+                                cycles,
+                                _id);
+                    }
+#else
+                    solver.find_cycles(
+                            hex_header_hash.data(),
+                            hex_header_hash.size(),
                             edgebits,
                             CUCKOO_PROOF_SIZE,
                             cycles,
-                            _id);
-                }
-#else
-                bool found = cuckoo::FindCycles(
-                        hex_header_hash.data(),
-                        hex_header_hash.size(),
-                        edgebits,
-                        CUCKOO_PROOF_SIZE,
-                        cycles,
-                        _threads,
-                        _pool);
+                            cancel);
 #endif
+                }
 
-                auto& stat = _miner.current_stat();
-                stat.attempts++;
-
-                if(found) {
-                    stat.cycles+=cycles.size();
-
-                    int idx = 0;
-                    for(const auto& cycle: cycles) {
-                        assert(cycle.size() == work->cycle.size());
-                        assert(work->cycle.size() == CUCKOO_PROOF_SIZE);
-
-                        std::copy(cycle.begin(), cycle.end(), work->cycle.begin());
-
-                        std::array<uint32_t, 8> cycle_hash;
-                        std::array<uint8_t, 1 + sizeof(uint32_t) * CUCKOO_PROOF_SIZE> cycle_with_size;
-                        cycle_with_size[0] = CUCKOO_PROOF_SIZE;
-                        std::copy(
-                                reinterpret_cast<const uint8_t*>(work->cycle.data()),
-                                reinterpret_cast<const uint8_t*>(work->cycle.data()) + sizeof(uint32_t) * work->cycle.size(),
-                                cycle_with_size.begin()+1);
-
-                        util::double_sha256(
-                                reinterpret_cast<unsigned char*>(cycle_hash.data()),
-                                cycle_with_size.data(),
-                                cycle_with_size.size());
-
-                        std::string cycle_hash_hex;
-                        util::to_hex(cycle_with_size, cycle_hash_hex);
-
-                        if(target_test(cycle_hash, work->target)) {
-                            std::cout << "info :: " << termcolor::green << "(" << _id << ") found share (" << idx << "): " << cycle_hash_hex << termcolor::reset << std::endl;
-                            stat.shares++;
-                            _miner.submit_work(*work);
-                        } else {
-                            std::cout << "info :: " << termcolor::blue << "(" << _id << ") found cycle (" << idx << "): " << cycle_hash_hex << termcolor::reset << std::endl;
-                        }
+                if(solver.allocated()) {
+                    _page_backing = static_cast<int>(solver.page_backing());
+                }
 
-                        idx++;
+                // an aborted graph only ran some of the rounds
+                if(!_gpu_device && !solver.aborted()) {
+                    if(const auto telemetry = solver.telemetry()) {
+                        _miner.add_telemetry(edgebits, *telemetry);
                     }
                 }
+
+                if(solver.engine() != engine) {
+                    engine = solver.engine();
+                    std::cout << "info :: worker " << _id << " solver: " << termcolor::cyan << cuckoo::to_string(engine) << termcolor::reset << std::endl;
+                }
+
+                if(solved) {
+                    found_cycles(*work, cycles, cancel);
+                }
             }
+
+            if(pending.valid()) {
+                found_cycles(pending_work, pending.get(), pending_cancel);
+            }
+
             _state = NotRunning;
             std::cout << "info :: " << "worker " << _id << " stopped..." << std::endl;
         }
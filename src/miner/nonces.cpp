@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/miner/nonces.hpp"
+#include "merit/termcolor/termcolor.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace merit
+{
+    namespace miner
+    {
+        namespace
+        {
+            const std::uint64_t NONCES = std::uint64_t{1} << 32;
+
+            bool header_same(const util::Work& a, const util::Work& b)
+            {
+                return std::equal(
+                        a.data.begin(),
+                        a.data.begin()+19,
+                        b.data.begin());
+            }
+
+            // the coinbase of a job carries zeros where extranonce2 goes
+            util::Work job_variant(stratum::Job j, std::uint64_t xnonce2, std::uint32_t ntime_roll)
+            {
+                const auto size = std::min<size_t>(j.xnonce2_size, sizeof(xnonce2));
+                for(size_t i = 0; i < size; i++) {
+                    j.coinbase[j.xnonce2_start + i] = static_cast<unsigned char>(xnonce2 >> (8 * i));
+                }
+
+                if(ntime_roll > 0) {
+                    assert(j.time.size() == 4);
+                    be32enc(j.time.data(), be32dec(j.time.data()) + ntime_roll);
+                }
+
+                return stratum::work_from_job(j);
+            }
+        }
+
+        bool NonceLease::empty() const
+        {
+            return next >= end;
+        }
+
+        NonceManager::NonceManager(std::uint32_t lease_size, std::uint32_t max_ntime_roll) :
+            _lease_size{std::max<std::uint32_t>(lease_size, 1)},
+            _max_ntime_roll{max_ntime_roll} {}
+
+        void NonceManager::reset(const stratum::Job& j, WorkSnapshot work, std::uint64_t version)
+        {
+            assert(work);
+            std::lock_guard<std::mutex> guard{_mutex};
+            _version = version;
+
+            // a resent job continues where the last one stopped, on the
+            // variant it got to
+            if(_job && _base && header_same(*_base, *work)) {
+                _job = j;
+                return;
+            }
+
+            _job = j;
+            _base = work;
+            _work = std::move(work);
+            _next = 0;
+            _xnonce2 = 0;
+            _ntime_roll = 0;
+            _exhausted = false;
+        }
+
+        void NonceManager::clear(std::uint64_t version)
+        {
+            std::lock_guard<std::mutex> guard{_mutex};
+            _version = version;
+            _job = boost::none;
+            _base = nullptr;
+            _work = nullptr;
+        }
+
+        bool NonceManager::lease(NonceLease& l)
+        {
+            std::lock_guard<std::mutex> guard{_mutex};
+            l.version = _version;
+            l.work = nullptr;
+            l.next = l.end = 0;
+
+            if(!_job || _exhausted) {
+                return false;
+            }
+
+            if(_next >= NONCES && !roll()) {
+                _exhausted = true;
+                std::cout << "info :: " << termcolor::yellow << "nonce space of job " << _job->id << " exhausted" << termcolor::reset << std::endl;
+                return false;
+            }
+
+            l.work = _work;
+            l.next = _next;
+            l.end = std::min(_next + _lease_size, NONCES);
+            _next = l.end;
+            return true;
+        }
+
+        bool NonceManager::roll()
+        {
+            assert(_job);
+            const auto bits = 8 * _job->xnonce2_size;
+            const bool xnonce2_left = bits >= 64 ? _xnonce2 < UINT64_MAX : _xnonce2 + 1 < (std::uint64_t{1} << bits);
+
+            if(xnonce2_left) {
+                _xnonce2++;
+            } else if(_ntime_roll < _max_ntime_roll) {
+                _ntime_roll++;
+                _xnonce2 = 0;
+            } else {
+                return false;
+            }
+
+            _work = std::make_shared<const util::Work>(job_variant(*_job, _xnonce2, _ntime_roll));
+            _next = 0;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/miner/profile.hpp"
+#include "merit/termcolor/termcolor.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace merit
+{
+    namespace miner
+    {
+        namespace
+        {
+            std::uint64_t physical_memory()
+            {
+#ifdef __linux__
+                return static_cast<std::uint64_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE);
+#else
+                return 0;
+#endif
+            }
+
+            std::uint64_t layout_bytes(
+                    int edgebits,
+                    const Layout& layout,
+                    const cuckoo::SolverOptions& options)
+            {
+                const std::uint64_t worker = layout.batch ?
+                    layout.threads_per_worker * cuckoo::mean_bytes(edgebits, 1) :
+                    cuckoo::mean_bytes(edgebits, layout.threads_per_worker, options.parallel_cycles);
+                return layout.workers * worker;
+            }
+
+            // runs the layout's workers side by side on synthetic headers
+            // and returns the graphs they solved per second together.
+            double measure(
+                    int edgebits,
+                    const Layout& layout,
+                    std::chrono::seconds per_layout,
+                    const cuckoo::SolverOptions& options)
+            {
+                ctpl::thread_pool pool{layout.workers * layout.threads_per_worker};
+                std::vector<double> rates(layout.workers, 0);
+                std::vector<std::thread> workers;
+
+                for(int w = 0; w < layout.workers; w++) {
+                    workers.emplace_back([&, w]() {
+                        cuckoo::Solver solver{static_cast<size_t>(layout.threads_per_worker), pool, options};
+                        int graph = 0;
+
+                        auto header = [edgebits, w, &graph]() {
+                            char h[65];
+                            std::snprintf(h, sizeof(h), "%08x%08x%048x", edgebits, w, graph++);
+                            return std::string{h};
+                        };
+
+                        auto solve = [&]() {
+                            if(layout.batch) {
+                                std::vector<std::string> headers;
+                                for(int t = 0; t < layout.threads_per_worker; t++) {
+                                    headers.push_back(header());
+                                }
+                                std::vector<cuckoo::Cycles> cycles;
+                                solver.find_cycles_batch(headers, edgebits, 42, cycles);
+                                return layout.threads_per_worker;
+                            }
+                            const auto h = header();
+                            cuckoo::Cycles cycles;
+                            solver.find_cycles(h.data(), h.size(), edgebits, 42, cycles);
+                            return 1;
+                        };
+
+                        // the first graph pays for building the solver
+                        solve();
+
+                        int graphs = 0;
+                        const auto start = std::chrono::steady_clock::now();
+                        std::chrono::duration<double> elapsed;
+                        do {
+                            graphs += solve();
+                            elapsed = std::chrono::steady_clock::now() - start;
+                        } while(elapsed < per_layout);
+
+                        rates[w] = graphs / elapsed.count();
+                    });
+                }
+
+                for(auto& w : workers) {
+                    w.join();
+                }
+
+                double rate = 0;
+                for(auto r : rates) {
+                    rate += r;
+                }
+                return rate;
+            }
+        }
+
+        bool load_profile(const std::string& path, Profile& profile)
+        {
+            std::ifstream in{path};
+            if(!in) {
+                return false;
+            }
+
+            std::string line;
+            while(std::getline(in, line)) {
+                if(line.empty() || line[0] == '#') {
+                    continue;
+                }
+
+                std::istringstream s{line};
+                int edgebits;
+                Layout layout;
+                if(!(s >> edgebits >> layout.workers >> layout.threads_per_worker >> layout.batch >> layout.graphs_per_second)) {
+                    return false;
+                }
+                if(layout.workers < 1 || layout.threads_per_worker < 1) {
+                    return false;
+                }
+                profile[edgebits] = layout;
+            }
+            return true;
+        }
+
+        bool save_profile(const std::string& path, const Profile& profile)
+        {
+            std::ofstream out{path};
+            if(!out) {
+                return false;
+            }
+
+            out << "# edgebits workers threads_per_worker batch graphs_per_second" << std::endl;
+            for(const auto& p : profile) {
+                const auto& l = p.second;
+                out << p.first << ' ' << l.workers << ' ' << l.threads_per_worker << ' '
+                    << l.batch << ' ' << l.graphs_per_second << std::endl;
+            }
+            return static_cast<bool>(out);
+        }
+
+        Profile tune(
+                int cores,
+                const std::vector<int>& edgebits,
+                std::chrono::seconds per_layout,
+                const cuckoo::SolverOptions& options)
+        {
+            const std::uint64_t memory = physical_memory();
+
+            Profile profile;
+            for(int eb : edgebits) {
+                for(int threads = 1; threads <= cores; threads++) {
+                    if(cores % threads) {
+                        continue;
+                    }
+
+                    for(int batch = 0; batch < (threads > 1 ? 2 : 1); batch++) {
+                        Layout layout;
+                        layout.workers = cores / threads;
+                        layout.threads_per_worker = threads;
+                        layout.batch = batch;
+
+                        // leave a quarter of the memory to everything else
+                        if(memory > 0 && layout_bytes(eb, layout, options) > memory / 4 * 3) {
+                            continue;
+                        }
+
+                        layout.graphs_per_second = measure(eb, layout, per_layout, options);
+                        std::cout << "info :: tune edgebits " << eb << ": "
+                            << termcolor::cyan << layout.workers << " x " << layout.threads_per_worker
+                            << (layout.batch ? " batched" : "") << termcolor::reset << " "
+                            << termcolor::cyan << layout.graphs_per_second << termcolor::reset << " graphs/s" << std::endl;
+
+                        auto best = profile.find(eb);
+                        if(best == profile.end() || layout.graphs_per_second > best->second.graphs_per_second) {
+                            profile[eb] = layout;
+                        }
+                    }
+                }
+
+                auto best = profile.find(eb);
+                if(best == profile.end()) {
+                    std::cout << "info :: " << termcolor::yellow << "no layout for edgebits " << eb << " fits in memory" << termcolor::reset << std::endl;
+                }
+            }
+            return profile;
+        }
+    }
+}
@@ -50,6 +50,64 @@ std::pair<int, int> determine_utilization(int cores)
     return cores & 1 ? std::make_pair(cores, 1) : std::make_pair(cores / 2, 2);
 }
 
+bool parse_page_backing(const std::string& s, merit::PageBacking& pages)
+{
+    if(s == "none") {
+        pages = merit::PageBacking::Normal;
+    } else if(s == "thp") {
+        pages = merit::PageBacking::Transparent;
+    } else if(s == "2mb") {
+        pages = merit::PageBacking::Huge2MB;
+    } else if(s == "1gb") {
+        pages = merit::PageBacking::Huge1GB;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_isa(const std::string& s, merit::Isa& isa)
+{
+    if(s == "auto") {
+        isa = merit::Isa::Auto;
+    } else if(s == "scalar") {
+        isa = merit::Isa::Scalar;
+    } else if(s == "avx2") {
+        isa = merit::Isa::AVX2;
+    } else if(s == "avx512") {
+        isa = merit::Isa::AVX512;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_engine(const std::string& s, merit::Engine& engine)
+{
+    if(s == "auto") {
+        engine = merit::Engine::Auto;
+    } else if(s == "mean") {
+        engine = merit::Engine::Mean;
+    } else if(s == "lean") {
+        engine = merit::Engine::Lean;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_smt(const std::string& s, merit::Smt& smt)
+{
+    if(s == "pair") {
+        smt = merit::Smt::Pair;
+    } else if(s == "exclude") {
+        smt = merit::Smt::Exclude;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 int main(int argc, char** argv) 
 {
     merit::init();
@@ -61,6 +119,13 @@ int main(int argc, char** argv)
     std::deque<std::string> reserve_pools_url_deq;
     std::vector<int> gpu_devices;
     std::string address;
+    std::string hugepages;
+    std::string isa;
+    std::string engine;
+    std::string smt;
+    std::string profile;
+    std::vector<int> tune_edgebits;
+    merit::MinerOptions options;
     desc.add_options()
         ("help,h", "show the help message")
         ("infogpu,i", "show the info about GPU in your system")
@@ -68,7 +133,27 @@ int main(int argc, char** argv)
         ("reserveurl,r", po::value<std::vector<std::string>>(&all_pools_url)->multitoken(), "Reserved pools url")
         ("address,a", po::value<std::string>(&address), "The address to send mining rewards to.")
         ("gpu,g", po::value<std::vector<int>>(&gpu_devices)->multitoken(), "Index of GPU device to use in mining(can use multiple times). For more info check --infogpu")
-        ("cores,c", po::value<int>()->default_value(merit::number_of_cores()), "The number of CPU cores to use.");
+        ("cores,c", po::value<int>()->default_value(merit::number_of_cores()), "The number of CPU cores to use.")
+        ("hugepages", po::value<std::string>(&hugepages)->default_value("none"), "Page size backing the solver memory: none, thp, 2mb or 1gb. Falls back to smaller pages when none are reserved.")
+        ("numa", "Pin each worker and its solver memory to a single NUMA node.")
+        ("pin-caches", "Give each worker its own cores sharing a last level cache.")
+        ("smt", po::value<std::string>(&smt)->default_value("pair"), "SMT siblings with --pin-caches: pair puts both threads of a core on one worker, exclude uses one thread per core.")
+        ("isa", po::value<std::string>(&isa)->default_value("auto"), "SIMD level of the solver: auto, scalar, avx2 or avx512. Levels the CPU lacks fall back to the best it has.")
+        ("barrier-spin", po::value<int>(&options.barrier_spin_us)->default_value(options.barrier_spin_us), "Microseconds solver threads spin between trimming rounds before sleeping. Use 0 when sharing the CPU.")
+        ("trim-stop", po::value<double>(&options.trim_stop_rate)->default_value(0), "Stop trimming a graph once a pair of rounds removes less than this share of its edges, e.g. 0.1. 0 runs the full round count.")
+        ("batch-edgebits", po::value<int>(&options.batch_edgebits)->default_value(options.batch_edgebits), "Graphs with fewer edge bits are solved one per thread instead of split over all of a worker's threads. 0 turns batching off.")
+        ("streaming-stores", "Write the first trimming rounds with streaming stores. Can help many threads on large graphs, see merit-bench stores.")
+        ("telemetry", "Time every solver stage and log where the time of each graph size goes.")
+        ("pipeline", "Search a graph for cycles on an extra thread while the next one is trimmed.")
+        ("parallel-cycles", "Search the trimmed graph for cycles on all of a worker's threads. Slower on small graphs, see merit-bench cycles.")
+        ("solver", po::value<std::string>(&engine)->default_value("auto"), "Solver engine: auto, mean or lean. Lean needs about an eighth of the memory but is slower.")
+        ("memory-budget", po::value<int>(&options.memory_budget_mb)->default_value(0), "MB of memory each worker's solver may use. With --solver auto, graphs that don't fit use the lean solver. 0 means no limit.")
+        ("total-memory", po::value<int>(&options.total_memory_mb)->default_value(0), "MB of memory all workers' solvers may use together. Workers that don't fit a job's graphs are merged into fewer, larger ones. 0 means no limit.")
+        ("ntime-roll", po::value<int>(&options.ntime_roll_s)->default_value(0), "Seconds past a job's time the header time may be rolled once its nonces and extranonce2 run out. Only use as far as the pool accepts. 0 never rolls it.")
+        ("profile", po::value<std::string>(&profile), "Miner profile written by --tune. Jobs with profiled edge bits use the tuned worker layout.")
+        ("tune", "Benchmark worker layouts for --tune-edgebits on this host, write them to --profile and exit.")
+        ("tune-edgebits", po::value<std::vector<int>>(&tune_edgebits)->multitoken(), "Edge bits to tune for. Defaults to 18 20 22 24 26.")
+        ("tune-seconds", po::value<int>()->default_value(10), "Seconds spent benchmarking each layout.");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -95,7 +180,17 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    if(address.empty()) {
+    if(vm.count("tune")) {
+        if(profile.empty()) {
+            std::cerr << termcolor::red << "set the file to write the tuned layouts to with --profile" << termcolor::reset << std::endl;
+            return 1;
+        }
+        if(tune_edgebits.empty()) {
+            tune_edgebits = {18, 20, 22, 24, 26};
+        }
+    }
+
+    if(address.empty() && !vm.count("tune")) {
         std::cerr << termcolor::red << "forgot to set your reward address. use -a or --address" << termcolor::reset << std::endl;
         return 1;
     }
@@ -109,9 +204,38 @@ int main(int argc, char** argv)
         }
     }
 
+    if(!parse_page_backing(hugepages, options.pages)) {
+        std::cerr << termcolor::red << "unknown --hugepages value: " << hugepages << ". Use none, thp, 2mb or 1gb." << termcolor::reset << std::endl;
+        return 1;
+    }
+    options.numa = vm.count("numa") > 0;
+    options.pin_caches = vm.count("pin-caches") > 0;
+    if(!parse_smt(smt, options.smt)) {
+        std::cerr << termcolor::red << "unknown --smt value: " << smt << ". Use pair or exclude." << termcolor::reset << std::endl;
+        return 1;
+    }
+    options.pipeline = vm.count("pipeline") > 0;
+    options.parallel_cycles = vm.count("parallel-cycles") > 0;
+    options.telemetry = vm.count("telemetry") > 0;
+    options.streaming_stores = vm.count("streaming-stores") > 0;
+    if(!parse_engine(engine, options.engine)) {
+        std::cerr << termcolor::red << "unknown --solver value: " << engine << ". Use auto, mean or lean." << termcolor::reset << std::endl;
+        return 1;
+    }
+    if(!parse_isa(isa, options.isa)) {
+        std::cerr << termcolor::red << "unknown --isa value: " << isa << ". Use auto, scalar, avx2 or avx512." << termcolor::reset << std::endl;
+        return 1;
+    }
+
     int cores;
     cores = vm["cores"].as<int>();
     cores = std::max(0, cores);
+
+    if(vm.count("tune")) {
+        return merit::tune_miner(cores, tune_edgebits, vm["tune-seconds"].as<int>(), profile, options) ? 0 : 1;
+    }
+
+    options.profile = profile;
     auto utilization = determine_utilization(cores);
 
     std::unique_ptr<merit::Context, decltype(&merit::delete_context)> c{
@@ -127,9 +251,12 @@ int main(int argc, char** argv)
     }
     
     merit::run_stratum(c.get());
-    merit::run_miner(c.get(), utilization.first ,utilization.second, gpu_devices);
+    merit::run_miner(c.get(), utilization.first ,utilization.second, gpu_devices, options);
 
     int prev_graphs = 0;
+    std::string prev_page_backing;
+    std::string prev_isa;
+    int64_t prev_memory_mb = 0;
     while(true) { 
         using namespace std::chrono_literals;
         std::this_thread::sleep_for(5s);
@@ -138,6 +265,7 @@ int main(int argc, char** argv)
         auto graphs = stats.total.attempts + stats.current.attempts;
         auto cycles = stats.total.cycles + stats.current.cycles;
         auto shares = stats.total.shares + stats.current.shares;
+        auto aborted = stats.total.aborted + stats.current.aborted;
         auto graphps = stats.total.attempts_per_second;
         auto cyclesps = stats.total.cycles_per_second;
         auto sharesps = stats.total.shares_per_second;
@@ -145,6 +273,9 @@ int main(int argc, char** argv)
             std::cout << "info :: graphs: " << termcolor::cyan << graphs << termcolor::reset
                       << " cycles: " << termcolor::cyan << cycles << termcolor::reset
                       << " shares: " << termcolor::cyan << shares << termcolor::reset;
+            if(aborted > 0) {
+                std::cout << " aborted: " << termcolor::cyan << aborted << termcolor::reset;
+            }
             if(stats.total.attempts > 0) {
                 std::cout << " graphs/s: " << termcolor::cyan << graphps << termcolor::reset
                           << " cycles/s: " << termcolor::cyan << cyclesps << termcolor::reset
@@ -152,8 +283,49 @@ int main(int argc, char** argv)
             } else {
                 std::cout << std::endl;
             }
+
+            if(stats.nodes.size() > 1) {
+                for(const auto& n : stats.nodes) {
+                    std::cout << "info :: node " << n.node
+                              << " workers: " << termcolor::cyan << n.workers << termcolor::reset
+                              << " graphs: " << termcolor::cyan << n.attempts << termcolor::reset
+                              << " graphs/s: " << termcolor::cyan << n.attempts_per_second << termcolor::reset << std::endl;
+                }
+            }
+
+            for(const auto& solver : stats.solver) {
+                double trim_ms = 0;
+                for(const auto& r : solver.rounds) {
+                    trim_ms += r.ms;
+                }
+                std::cout << "info :: edgebits " << solver.edgebits
+                          << " ms/graph trim: " << termcolor::cyan << trim_ms << termcolor::reset
+                          << " find: " << termcolor::cyan << solver.find_ms << termcolor::reset
+                          << " match: " << termcolor::cyan << solver.match_ms << termcolor::reset
+                          << " rounds: " << termcolor::cyan << solver.rounds.size() << termcolor::reset;
+                if(!solver.rounds.empty()) {
+                    std::cout << " edges left: " << termcolor::cyan << solver.rounds.back().edges << termcolor::reset;
+                }
+                std::cout << std::endl;
+            }
         }
         prev_graphs = graphs;
+
+        if(stats.page_backing != prev_page_backing) {
+            std::cout << "info :: solver pages: " << termcolor::cyan << stats.page_backing << termcolor::reset << std::endl;
+            prev_page_backing = stats.page_backing;
+        }
+
+        if(stats.isa != prev_isa) {
+            std::cout << "info :: solver isa: " << termcolor::cyan << stats.isa << termcolor::reset << std::endl;
+            prev_isa = stats.isa;
+        }
+
+        if((stats.memory_bytes >> 20) != prev_memory_mb) {
+            std::cout << "info :: solver memory: " << termcolor::cyan << (stats.memory_bytes >> 20) << "MB" << termcolor::reset
+                      << " peak: " << termcolor::cyan << (stats.peak_memory_bytes >> 20) << "MB" << termcolor::reset << std::endl;
+            prev_memory_mb = stats.memory_bytes >> 20;
+        }
     }
 
     return 0;
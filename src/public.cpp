@@ -31,8 +31,10 @@
 #include "merit/miner.hpp"
 #include "merit/stratum/stratum.hpp"
 #include "merit/miner/miner.hpp"
+#include "merit/cuckoo/verify.h"
 #include "merit/termcolor/termcolor.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <thread>
@@ -182,7 +184,86 @@ namespace merit
         c->stratum.stop();
     }
 
-    bool run_miner(Context* c, int workers, int threads_per_worker, const std::vector<int>& gpu_devices)
+    util::PageBacking to_page_backing(PageBacking p)
+    {
+        switch(p) {
+            case PageBacking::Normal: return util::PageBacking::Normal;
+            case PageBacking::Transparent: return util::PageBacking::Transparent;
+            case PageBacking::Huge2MB: return util::PageBacking::Huge2MB;
+            case PageBacking::Huge1GB: return util::PageBacking::Huge1GB;
+        }
+        assert(false && "unknown page backing");
+        return util::PageBacking::Normal;
+    }
+
+    util::Isa to_isa(Isa isa)
+    {
+        switch(isa) {
+            case Isa::Auto: return util::Isa::Auto;
+            case Isa::Scalar: return util::Isa::Scalar;
+            case Isa::AVX2: return util::Isa::AVX2;
+            case Isa::AVX512: return util::Isa::AVX512;
+        }
+        assert(false && "unknown isa");
+        return util::Isa::Auto;
+    }
+
+    cuckoo::Engine to_engine(Engine e)
+    {
+        switch(e) {
+            case Engine::Auto: return cuckoo::Engine::Auto;
+            case Engine::Mean: return cuckoo::Engine::Mean;
+            case Engine::Lean: return cuckoo::Engine::Lean;
+        }
+        assert(false && "unknown engine");
+        return cuckoo::Engine::Auto;
+    }
+
+    util::Smt to_smt(Smt smt)
+    {
+        switch(smt) {
+            case Smt::Pair: return util::Smt::Pair;
+            case Smt::Exclude: return util::Smt::Exclude;
+        }
+        assert(false && "unknown smt");
+        return util::Smt::Pair;
+    }
+
+    miner::Options to_miner_options(const MinerOptions& o)
+    {
+        miner::Options r;
+        r.solver.pages = to_page_backing(o.pages);
+        r.numa = o.numa;
+        r.pin_caches = o.pin_caches;
+        r.smt = to_smt(o.smt);
+        r.solver.isa = to_isa(o.isa);
+        r.solver.barrier_spin = std::chrono::microseconds{std::max(0, o.barrier_spin_us)};
+        r.solver.engine = to_engine(o.engine);
+        r.solver.memory_budget = static_cast<std::uint64_t>(std::max(0, o.memory_budget_mb)) << 20;
+        r.memory_limit = static_cast<std::uint64_t>(std::max(0, o.total_memory_mb)) << 20;
+        r.max_ntime_roll = static_cast<std::uint32_t>(std::max(0, o.ntime_roll_s));
+        r.solver.trim_stop_rate = std::max(0.0, o.trim_stop_rate);
+        for(auto e : o.worker_engines) {
+            r.worker_engines.push_back(to_engine(e));
+        }
+        r.pipeline = o.pipeline;
+        r.solver.parallel_cycles = o.parallel_cycles;
+        r.batch_edgebits = o.batch_edgebits;
+        r.solver.telemetry = o.telemetry;
+        r.solver.streaming_stores = o.streaming_stores;
+        if(!o.profile.empty() && !miner::load_profile(o.profile, r.profile)) {
+            std::cerr << termcolor::yellow << "warning: " << "unable to read miner profile " << o.profile << termcolor::reset << std::endl;
+            r.profile.clear();
+        }
+        return r;
+    }
+
+    bool run_miner(
+            Context* c,
+            int workers,
+            int threads_per_worker,
+            const std::vector<int>& gpu_devices,
+            const MinerOptions& options)
     try
     {
         assert(c);
@@ -200,7 +281,8 @@ namespace merit
                 workers,
                 threads_per_worker,
                 gpu_devices,
-                c->submit_work_func);
+                c->submit_work_func,
+                to_miner_options(options));
 
         std::cout << "info :: " << "starting miner..."<< std::endl; 
         if(c->mining_thread.joinable()) {
@@ -221,15 +303,18 @@ namespace merit
             c->collab_thread.join();
         }
         c->collab_thread = std::thread([c]() {
-                while(c->miner->state() != miner::Miner::Running) {}
+                while(c->miner->state() != miner::Miner::Running) {
+                    std::this_thread::sleep_for(1ms);
+                }
                 while(c->miner->running()) 
                 try {
-                    auto j = c->stratum.get_job();
+                    // wakes as soon as the stratum thread parses a job
+                    auto j = c->stratum.get_job(100ms);
                     if(!j) { 
                         if(!c->stratum.connected()) {
                             c->miner->clear_job();
+                            std::this_thread::sleep_for(50ms);
                         }
-                        std::this_thread::sleep_for(50ms);
                         continue;
                     }
 
@@ -248,6 +333,36 @@ namespace merit
         return false;
     }
 
+    bool tune_miner(
+            int cores,
+            const std::vector<int>& edgebits,
+            int seconds_per_layout,
+            const std::string& profile,
+            const MinerOptions& options)
+    try
+    {
+        auto solver = to_miner_options(options).solver;
+        solver.isa = cuckoo::select_isa(solver.isa);
+
+        const auto tuned = miner::tune(
+                std::max(1, cores),
+                edgebits,
+                std::chrono::seconds{std::max(1, seconds_per_layout)},
+                solver);
+
+        if(!miner::save_profile(profile, tuned)) {
+            std::cerr << termcolor::red << "error: " << "unable to write miner profile " << profile << termcolor::reset << std::endl;
+            return false;
+        }
+        std::cout << "info :: " << "wrote miner profile " << profile << std::endl;
+        return true;
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << termcolor::red  << "error: " << "error tuning miner: " << e.what() << termcolor::reset << std::endl;
+        return false;
+    }
+
     void stop_miner(Context* c)
     {
         assert(c);
@@ -281,6 +396,23 @@ namespace merit
         return c->miner  && c->miner->stopping();
     }
 
+    bool verify_cycle(
+            const std::string& hex_header_hash,
+            int edgebits,
+            const std::vector<uint32_t>& cycle,
+            int proofsize)
+    {
+        if(edgebits < 0 || edgebits > 32 || proofsize < 0 || cycle.size() != static_cast<size_t>(proofsize)) {
+            return false;
+        }
+        return cuckoo::verify_cycle(
+                hex_header_hash.data(),
+                hex_header_hash.size(),
+                edgebits,
+                cycle.data(),
+                proofsize) == cuckoo::CycleStatus::Ok;
+    }
+
     int number_of_cores()
     {
         return std::thread::hardware_concurrency();
@@ -307,7 +439,8 @@ namespace merit
             s.shares_per_second(),
             s.attempts,
             s.cycles,
-            s.shares
+            s.shares,
+            s.aborted
         };
     }
 
@@ -331,6 +464,31 @@ namespace merit
                 s.history.begin(),
                 to_public_stat);
 
+        auto backing = c->miner->page_backing();
+        if(backing) {
+            s.page_backing = util::to_string(*backing);
+        }
+        s.isa = util::to_string(c->miner->options().solver.isa);
+        s.memory_bytes = util::allocated_bytes();
+        s.peak_memory_bytes = util::peak_allocated_bytes();
+
+        for(const auto& n : c->miner->node_stats()) {
+            s.nodes.push_back({n.node, n.workers, n.attempts, n.attempts_per_second()});
+        }
+
+        for(const auto& e : c->miner->stage_stats()) {
+            const auto& st = e.second;
+            if(st.graphs == 0) {
+                continue;
+            }
+            SolverStat solver{e.first, st.graphs, st.find_ms / st.graphs, st.match_ms / st.graphs, {}};
+            for(size_t r = 0; r < st.round_ms.size(); r++) {
+                const double g = std::max(1, st.round_graphs[r]);
+                solver.rounds.push_back({st.round_ms[r] / g, st.round_edges[r] / g});
+            }
+            s.solver.push_back(solver);
+        }
+
         return s;
     }
 
@@ -219,11 +219,15 @@ namespace merit
             _next_diff = 0.0;
             _xnonce1.clear();
             _xnonce2_size = 0;
-            _job = Job{};
-            _new_job = false;
+            {
+                std::lock_guard<std::mutex> jguard{_job_mutex};
+                _job = Job{};
+                _new_job = false;
+            }
 
             _socket.close();
             _state = Disconnected;
+            _job_cv.notify_all();
         }
 
         bool parse_json(const std::string& s, pt::ptree& r)
@@ -342,6 +346,7 @@ namespace merit
             std::cout << "info :: " << "notify: " << j.id << " time: " << *time << " nbits: " << *nbits << " edgebits: " << j.nedgebits << " prevhash: " << *prevhash << std::endl;
 
             _job = j;
+            _job_cv.notify_all();
 
             return true;
         }
@@ -566,6 +571,7 @@ namespace merit
         void Client::stop()
         {
             _run_state = Stopping;
+            _job_cv.notify_all();
         }
 
         bool Client::connected() const
@@ -583,9 +589,12 @@ namespace merit
             return _run_state == Stopping;
         }
 
-        MaybeJob Client::get_job()
+        MaybeJob Client::get_job(std::chrono::milliseconds wait)
         {
-            std::lock_guard<std::mutex> guard{_job_mutex};
+            std::unique_lock<std::mutex> guard{_job_mutex};
+            _job_cv.wait_for(guard, wait, [this]() {
+                    return _new_job || _state == Disconnected || _run_state == Stopping;
+            });
 
             if(!_new_job) {
                 return MaybeJob{};
@@ -846,6 +855,7 @@ namespace merit
             w.data[18] = le32dec(j.nbits.data());
             w.data[20] = (j.nedgebits << 24) | (1 << 23);
             w.data[31] = 0x00000288;
+            util::update_midstate(w);
 
             diff_to_target(w.target, j.diff);
 
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/util/barrier.hpp"
+
+#include <algorithm>
+#include <new>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+namespace merit
+{
+    namespace util
+    {
+        namespace
+        {
+            inline void cpu_relax()
+            {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+                __builtin_ia32_pause();
+#endif
+            }
+
+            // constructs the i-th cache line aligned counter in lines, which
+            // has a line to spare for the alignment
+            std::atomic<std::uint32_t>& line(unsigned char* lines, size_t i, std::uint32_t value)
+            {
+                const auto base = (reinterpret_cast<std::uintptr_t>(lines) + CACHE_LINE - 1) & ~std::uintptr_t{CACHE_LINE - 1};
+                return *new (reinterpret_cast<void*>(base + i * CACHE_LINE)) std::atomic<std::uint32_t>{value};
+            }
+        }
+
+        BlockingBarrier::BlockingBarrier(size_t threads) :
+            _threads{threads},
+            _count{threads},
+            _generation{0}
+        {
+        }
+
+        void BlockingBarrier::wait()
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            auto generation = _generation;
+            if (!--_count) {
+                _generation++;
+                _count = _threads;
+                _cv.notify_all();
+            } else {
+                _cv.wait(lock, [this, generation] { return generation != _generation; });
+            }
+        }
+
+        constexpr std::chrono::microseconds SpinBarrier::DEFAULT_SPIN;
+
+        SpinBarrier::SpinBarrier(size_t threads, std::chrono::microseconds spin) :
+            _threads{static_cast<std::uint32_t>(threads)},
+            // spinning only pays when every thread has a core to spin on
+            _spin{threads > std::max(1u, std::thread::hardware_concurrency()) ? std::chrono::microseconds{0} : spin},
+            _count(line(_lines, 0, static_cast<std::uint32_t>(threads))),
+            _generation(line(_lines, 1, 0)),
+            _sleepers(line(_lines, 2, 0))
+        {
+            static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+                    "futex needs a plain 32 bit word");
+        }
+
+        void SpinBarrier::wait()
+        {
+            std::uint32_t generation;
+            if (arrive(generation)) {
+                release(generation);
+            } else {
+                await(generation);
+            }
+        }
+
+        bool SpinBarrier::arrive(std::uint32_t& generation)
+        {
+            generation = _generation.load(std::memory_order_acquire);
+            return _count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+
+        void SpinBarrier::release(std::uint32_t generation)
+        {
+            // last to arrive resets the count before releasing anyone so
+            // a fast thread can't reenter and see the old count.
+            _count.store(_threads, std::memory_order_relaxed);
+            _generation.store(generation + 1, std::memory_order_seq_cst);
+            if (_sleepers.load(std::memory_order_seq_cst) > 0) {
+                wake();
+            }
+        }
+
+        void SpinBarrier::await(std::uint32_t generation)
+        {
+            if (_spin.count() > 0) {
+                const auto start = std::chrono::steady_clock::now();
+                for (std::uint32_t i = 1; ; i++) {
+                    if (_generation.load(std::memory_order_acquire) != generation) {
+                        return;
+                    }
+                    cpu_relax();
+                    // reading the clock costs more than a pause, check it
+                    // every so often.
+                    if (!(i & 63) && std::chrono::steady_clock::now() - start >= _spin) {
+                        break;
+                    }
+                }
+            }
+
+            park(generation);
+        }
+
+        std::chrono::microseconds SpinBarrier::spin() const
+        {
+            return _spin;
+        }
+
+        void SpinBarrier::park(std::uint32_t generation)
+        {
+            _sleepers.fetch_add(1, std::memory_order_seq_cst);
+            while (_generation.load(std::memory_order_seq_cst) == generation) {
+#ifdef __linux__
+                syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&_generation),
+                        FUTEX_WAIT_PRIVATE, generation, nullptr, nullptr, 0);
+#else
+                std::this_thread::yield();
+#endif
+            }
+            _sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void SpinBarrier::wake()
+        {
+#ifdef __linux__
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&_generation),
+                    FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/util/cpu.hpp"
+
+#include <algorithm>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+namespace merit
+{
+    namespace util
+    {
+        const char* to_string(Isa isa)
+        {
+            switch(isa) {
+                case Isa::Auto: return "auto";
+                case Isa::Scalar: return "scalar";
+                case Isa::AVX2: return "avx2";
+                case Isa::AVX512: return "avx512";
+            }
+            return "unknown";
+        }
+
+        Isa detect_isa()
+        {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            // checks the xsave state enabled by the os as well as cpuid
+            __builtin_cpu_init();
+            if(__builtin_cpu_supports("avx512f")) {
+                return Isa::AVX512;
+            }
+            if(__builtin_cpu_supports("avx2")) {
+                return Isa::AVX2;
+            }
+#endif
+            return Isa::Scalar;
+        }
+
+        Isa resolve_isa(Isa requested)
+        {
+            static const Isa detected = detect_isa();
+            return requested == Isa::Auto ? detected : std::min(requested, detected);
+        }
+
+        bool has_sha_extensions()
+        {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            // the sha rounds need sse4.1 for the state shuffles
+            unsigned int eax, ebx, ecx, edx;
+            if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) {
+                return false;
+            }
+            if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+                return false;
+            }
+            return ebx & (1u << 29);
+#else
+            return false;
+#endif
+        }
+    }
+}
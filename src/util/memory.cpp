@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/util/memory.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+namespace merit
+{
+    namespace util
+    {
+        namespace
+        {
+            const size_t SMALL_PAGE = 4096;
+
+            std::atomic<std::uint64_t> allocated{0};
+            std::atomic<std::uint64_t> peak{0};
+
+            void account(const Pages& pages)
+            {
+                const std::uint64_t now = allocated += pages.size;
+                std::uint64_t p = peak.load();
+                while(now > p && !peak.compare_exchange_weak(p, now)) {
+                }
+            }
+            const size_t HUGE_2MB = 2 * 1024 * 1024;
+            const size_t HUGE_1GB = 1024 * 1024 * 1024;
+
+            size_t round_up(size_t bytes, size_t page)
+            {
+                return (bytes + page - 1) / page * page;
+            }
+
+#ifdef __linux__
+            void* map(size_t size, int flags)
+            {
+                void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+                return p == MAP_FAILED ? nullptr : p;
+            }
+
+            bool map_hugetlb(Pages& pages, size_t bytes, size_t page, int flags, PageBacking backing)
+            {
+                const size_t size = round_up(bytes, page);
+                void* p = map(size, MAP_HUGETLB | flags);
+                if(!p) {
+                    return false;
+                }
+
+                pages.data = p;
+                pages.size = size;
+                pages.backing = backing;
+                return true;
+            }
+
+            bool map_transparent(Pages& pages, size_t bytes)
+            {
+                // over allocate so the mapping can be trimmed to a 2MB boundary,
+                // otherwise the kernel can not back the edges with huge pages
+                const size_t size = round_up(bytes, HUGE_2MB);
+                auto p = reinterpret_cast<char*>(map(size + HUGE_2MB, 0));
+                if(!p) {
+                    return false;
+                }
+
+                auto aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<size_t>(p), HUGE_2MB));
+                if(aligned > p) {
+                    munmap(p, aligned - p);
+                }
+                auto end = p + size + HUGE_2MB;
+                if(end > aligned + size) {
+                    munmap(aligned + size, end - aligned - size);
+                }
+
+                pages.data = aligned;
+                pages.size = size;
+                pages.backing = madvise(aligned, size, MADV_HUGEPAGE) == 0 ?
+                    PageBacking::Transparent : PageBacking::Normal;
+                return true;
+            }
+
+            // prefer rather than bind so a full node spills instead of
+            // invoking the oom killer. first touch from pinned threads does
+            // the rest.
+            void bind_node(const Pages& pages, int node)
+            {
+                const size_t BITS = 8 * sizeof(unsigned long);
+                unsigned long mask[16] = {0};
+                if(node < 0 || node >= static_cast<int>(BITS * 16)) {
+                    return;
+                }
+
+                mask[node / BITS] = 1UL << (node % BITS);
+                syscall(SYS_mbind, pages.data, pages.size, MPOL_PREFERRED, mask, BITS * 16, 0);
+            }
+#endif
+        }
+
+        const char* to_string(PageBacking b)
+        {
+            switch(b) {
+                case PageBacking::Normal: return "4KB";
+                case PageBacking::Transparent: return "transparent 2MB";
+                case PageBacking::Huge2MB: return "hugetlb 2MB";
+                case PageBacking::Huge1GB: return "hugetlb 1GB";
+            }
+            return "unknown";
+        }
+
+        Pages allocate_pages(size_t bytes, PageBacking requested, int node)
+        {
+            Pages pages;
+#ifdef __linux__
+            bool mapped = false;
+            switch(requested) {
+                case PageBacking::Huge1GB:
+                    mapped = map_hugetlb(pages, bytes, HUGE_1GB, MAP_HUGE_1GB, PageBacking::Huge1GB);
+                    if(mapped) break;
+                    // fall through
+                case PageBacking::Huge2MB:
+                    mapped = map_hugetlb(pages, bytes, HUGE_2MB, MAP_HUGE_2MB, PageBacking::Huge2MB);
+                    if(mapped) break;
+                    // fall through
+                case PageBacking::Transparent:
+                    mapped = map_transparent(pages, bytes);
+                    if(mapped) break;
+                    // fall through
+                case PageBacking::Normal:
+                    break;
+            }
+
+            if(!mapped) {
+                pages.size = round_up(bytes, SMALL_PAGE);
+                pages.data = map(pages.size, 0);
+                pages.backing = PageBacking::Normal;
+            }
+
+            if(pages.data) {
+                bind_node(pages, node);
+                account(pages);
+                return pages;
+            }
+#else
+            pages.size = round_up(bytes, SMALL_PAGE);
+            pages.data = std::calloc(pages.size, 1);
+#endif
+            pages.backing = PageBacking::Normal;
+            if(!pages.data) {
+                throw std::bad_alloc{};
+            }
+            account(pages);
+            return pages;
+        }
+
+        void free_pages(Pages& pages)
+        {
+            if(!pages.data) {
+                return;
+            }
+#ifdef __linux__
+            munmap(pages.data, pages.size);
+#else
+            std::free(pages.data);
+#endif
+            allocated -= pages.size;
+            pages = Pages{};
+        }
+
+        std::uint64_t allocated_bytes()
+        {
+            return allocated;
+        }
+
+        std::uint64_t peak_allocated_bytes()
+        {
+            return peak;
+        }
+    }
+}
@@ -0,0 +1,505 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/util/sha256.hpp"
+#include "merit/util/cpu.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+
+// The sha extension and avx2 code is compiled with gcc target pragmas next
+// to the scalar code, like the cuckoo kernels, other compilers only get
+// the scalar code.
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define MERIT_SHA256_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace merit
+{
+    namespace util
+    {
+        namespace
+        {
+            using State = std::array<uint32_t, 8>;
+
+            const State INITIAL_STATE = {
+                0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+            alignas(16) const uint32_t K[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+            // compresses n consecutive 64 byte blocks into the state
+            using CompressFunc = void (*)(State& state, const unsigned char* blocks, size_t n);
+
+            // the same for eight messages, one per lane
+            using CompressX8Func = void (*)(State* states, const unsigned char* const* blocks, size_t n);
+
+            inline uint32_t rotr(uint32_t x, int n)
+            {
+                return (x >> n) | (x << (32 - n));
+            }
+
+            void compress_scalar(State& state, const unsigned char* blocks, size_t n)
+            {
+                for(; n > 0; n--, blocks += 64) {
+                    uint32_t w[64];
+                    for(int i = 0; i < 16; i++) {
+                        w[i] = be32dec(blocks + i * 4);
+                    }
+                    for(int i = 16; i < 64; i++) {
+                        const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                        const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                    }
+
+                    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+                    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+                    for(int i = 0; i < 64; i++) {
+                        const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+                        const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                        h = g;
+                        g = f;
+                        f = e;
+                        e = d + t1;
+                        d = c;
+                        c = b;
+                        b = a;
+                        a = t1 + t2;
+                    }
+
+                    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+                    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+                }
+            }
+        }
+    }
+}
+
+#ifdef MERIT_SHA256_DISPATCH
+
+#pragma GCC push_options
+#pragma GCC target("sha,sse4.1")
+namespace merit
+{
+    namespace util
+    {
+        namespace
+        {
+            // the state is kept as ABEF and CDGH, the layout sha256rnds2
+            // works on. each step runs four rounds and extends the
+            // schedule by four words.
+            void compress_shani(State& state, const unsigned char* blocks, size_t n)
+            {
+                const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+                __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xb1);
+                __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1b);
+                __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+                state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+                for(; n > 0; n--, blocks += 64) {
+                    const __m128i abef = state0;
+                    const __m128i cdgh = state1;
+
+                    __m128i m[4];
+                    for(int i = 0; i < 4; i++) {
+                        m[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + i * 16)), bswap);
+                    }
+
+#pragma GCC unroll 16
+                    for(int g = 0; g < 16; g++) {
+                        __m128i msg = _mm_add_epi32(m[g % 4], _mm_load_si128(reinterpret_cast<const __m128i*>(&K[g * 4])));
+                        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+                        if(g >= 3 && g < 15) {
+                            const __m128i next = _mm_add_epi32(m[(g + 1) % 4], _mm_alignr_epi8(m[g % 4], m[(g + 3) % 4], 4));
+                            m[(g + 1) % 4] = _mm_sha256msg2_epu32(next, m[g % 4]);
+                        }
+                        msg = _mm_shuffle_epi32(msg, 0x0e);
+                        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+                        if(g >= 1 && g < 13) {
+                            m[(g + 3) % 4] = _mm_sha256msg1_epu32(m[(g + 3) % 4], m[g % 4]);
+                        }
+                    }
+
+                    state0 = _mm_add_epi32(state0, abef);
+                    state1 = _mm_add_epi32(state1, cdgh);
+                }
+
+                tmp = _mm_shuffle_epi32(state0, 0x1b);
+                state1 = _mm_shuffle_epi32(state1, 0xb1);
+                state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+                state1 = _mm_alignr_epi8(state1, tmp, 8);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+            }
+        }
+    }
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace merit
+{
+    namespace util
+    {
+        namespace
+        {
+            inline __m256i rotr8(__m256i x, int n)
+            {
+                return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+            }
+
+            // one message per 32 bit lane, the states are transposed in and
+            // out of the lanes around the blocks
+            void compress_avx2_x8(State* states, const unsigned char* const* blocks, size_t n)
+            {
+                const __m256i bswap = _mm256_set_epi64x(
+                        0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+                        0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+                __m256i s[8];
+                for(int i = 0; i < 8; i++) {
+                    s[i] = _mm256_setr_epi32(
+                            states[0][i], states[1][i], states[2][i], states[3][i],
+                            states[4][i], states[5][i], states[6][i], states[7][i]);
+                }
+
+                for(size_t b = 0; b < n; b++) {
+                    __m256i w[64];
+                    for(int i = 0; i < 16; i++) {
+                        uint32_t lane[8];
+                        for(int l = 0; l < 8; l++) {
+                            std::memcpy(&lane[l], blocks[l] + b * 64 + i * 4, 4);
+                        }
+                        w[i] = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(lane)), bswap);
+                    }
+                    for(int i = 16; i < 64; i++) {
+                        const __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w[i - 15], 7), rotr8(w[i - 15], 18)), _mm256_srli_epi32(w[i - 15], 3));
+                        const __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w[i - 2], 17), rotr8(w[i - 2], 19)), _mm256_srli_epi32(w[i - 2], 10));
+                        w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i - 16], s0), _mm256_add_epi32(w[i - 7], s1));
+                    }
+
+                    __m256i a = s[0], bb = s[1], c = s[2], d = s[3];
+                    __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+                    for(int i = 0; i < 64; i++) {
+                        const __m256i sum1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+                        const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+                        const __m256i t1 = _mm256_add_epi32(
+                                _mm256_add_epi32(_mm256_add_epi32(h, sum1), _mm256_add_epi32(ch, w[i])),
+                                _mm256_set1_epi32(K[i]));
+                        const __m256i sum0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+                        const __m256i maj = _mm256_or_si256(_mm256_and_si256(a, bb), _mm256_and_si256(c, _mm256_or_si256(a, bb)));
+                        h = g;
+                        g = f;
+                        f = e;
+                        e = _mm256_add_epi32(d, t1);
+                        d = c;
+                        c = bb;
+                        bb = a;
+                        a = _mm256_add_epi32(t1, _mm256_add_epi32(sum0, maj));
+                    }
+
+                    s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], bb);
+                    s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+                    s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+                    s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+                }
+
+                for(int i = 0; i < 8; i++) {
+                    alignas(32) uint32_t lane[8];
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(lane), s[i]);
+                    for(int l = 0; l < 8; l++) {
+                        states[l][i] = lane[l];
+                    }
+                }
+            }
+        }
+    }
+}
+#pragma GCC pop_options
+
+#endif
+
+namespace merit
+{
+    namespace util
+    {
+        namespace
+        {
+            CompressFunc compress = compress_scalar;
+            CompressX8Func compress_x8 = nullptr;
+            Sha256Impl single_impl = Sha256Impl::Scalar;
+            Sha256Impl batch_impl = Sha256Impl::Scalar;
+
+            void select(Sha256Impl requested)
+            {
+                compress = compress_scalar;
+                compress_x8 = nullptr;
+                single_impl = Sha256Impl::Scalar;
+                batch_impl = Sha256Impl::Scalar;
+#ifdef MERIT_SHA256_DISPATCH
+                const bool sha = has_sha_extensions();
+                const bool avx2 = resolve_isa(Isa::Auto) >= Isa::AVX2;
+
+                // one sha extension stream keeps up with eight avx2 lanes,
+                // the lanes only pay off without the extensions
+                if(sha && (requested == Sha256Impl::Auto || requested == Sha256Impl::ShaNi)) {
+                    compress = compress_shani;
+                    single_impl = batch_impl = Sha256Impl::ShaNi;
+                } else if(avx2 && (requested == Sha256Impl::Auto || requested == Sha256Impl::AVX2)) {
+                    compress_x8 = compress_avx2_x8;
+                    batch_impl = Sha256Impl::AVX2;
+                }
+#endif
+            }
+
+            struct Selected
+            {
+                Selected() { select(Sha256Impl::Auto); }
+            };
+            const Selected selected;
+
+            // compresses the last len < 120 bytes of a total byte message
+            // with the padding and length appended
+            void compress_last(State& state, const unsigned char* data, size_t len, uint64_t total)
+            {
+                std::array<unsigned char, 128> block;
+                const size_t blocks = len < 56 ? 1 : 2;
+                std::copy(data, data + len, block.begin());
+                std::fill(block.begin() + len, block.begin() + blocks * 64, 0);
+                block[len] = 0x80;
+                be32enc(&block[blocks * 64 - 8], static_cast<uint32_t>((total * 8) >> 32));
+                be32enc(&block[blocks * 64 - 4], static_cast<uint32_t>(total * 8));
+                compress(state, block.data(), blocks);
+            }
+
+            // the 32 byte digest of the first pass is the second pass's
+            // only block
+            void second_pass(unsigned char* digest, const State& first)
+            {
+                std::array<unsigned char, 64> block;
+                for(int i = 0; i < 8; i++) {
+                    be32enc(&block[i * 4], first[i]);
+                }
+                std::fill(block.begin() + 32, block.end(), 0);
+                block[32] = 0x80;
+                block[62] = 0x01;
+
+                auto state = INITIAL_STATE;
+                compress(state, block.data(), 1);
+                for(int i = 0; i < 8; i++) {
+                    be32enc(digest + i * 4, state[i]);
+                }
+            }
+
+            void hash(State& state, const unsigned char* data, size_t len, uint64_t total)
+            {
+                compress(state, data, len / 64);
+                compress_last(state, data + len / 64 * 64, len % 64, total);
+            }
+
+            // pads the messages of up to eight lanes into one buffer per
+            // lane and runs them through the lanes together
+            void hash_x8(
+                    State* states,
+                    const unsigned char* data,
+                    size_t len,
+                    size_t stride,
+                    size_t lanes,
+                    uint64_t total)
+            {
+                const size_t blocks = (len + 8) / 64 + 1;
+                std::array<std::array<unsigned char, 64 * 4>, 8> padded;
+                std::array<const unsigned char*, 8> ptrs;
+                assert(blocks <= 4);
+
+                for(size_t l = 0; l < 8; l++) {
+                    auto& p = padded[l];
+                    const auto* msg = data + std::min(l, lanes - 1) * stride;
+                    std::copy(msg, msg + len, p.begin());
+                    std::fill(p.begin() + len, p.begin() + blocks * 64, 0);
+                    p[len] = 0x80;
+                    be32enc(&p[blocks * 64 - 8], static_cast<uint32_t>((total * 8) >> 32));
+                    be32enc(&p[blocks * 64 - 4], static_cast<uint32_t>(total * 8));
+                    ptrs[l] = p.data();
+                }
+                compress_x8(states, ptrs.data(), blocks);
+            }
+
+            void second_pass_x8(unsigned char* digests, const State* first, size_t lanes)
+            {
+                std::array<State, 8> states;
+                std::array<std::array<unsigned char, 32>, 8> digest;
+                for(size_t l = 0; l < 8; l++) {
+                    states[l] = first[l];
+                }
+
+                // the first digests are hashed as 32 byte messages
+                for(size_t l = 0; l < 8; l++) {
+                    for(int i = 0; i < 8; i++) {
+                        be32enc(&digest[l][i * 4], states[l][i]);
+                    }
+                    states[l] = INITIAL_STATE;
+                }
+                hash_x8(states.data(), digest[0].data(), 32, digest[1].data() - digest[0].data(), 8, 32);
+
+                for(size_t l = 0; l < lanes; l++) {
+                    for(int i = 0; i < 8; i++) {
+                        be32enc(digests + l * 32 + i * 4, states[l][i]);
+                    }
+                }
+            }
+        }
+
+        const char* to_string(Sha256Impl impl)
+        {
+            switch(impl) {
+                case Sha256Impl::Auto: return "auto";
+                case Sha256Impl::Scalar: return "scalar";
+                case Sha256Impl::AVX2: return "avx2";
+                case Sha256Impl::ShaNi: return "sha-ni";
+            }
+            return "unknown";
+        }
+
+        void select_sha256(Sha256Impl requested)
+        {
+            select(requested);
+        }
+
+        Sha256Impl sha256_impl()
+        {
+            return single_impl;
+        }
+
+        Sha256Impl sha256_batch_impl()
+        {
+            return batch_impl;
+        }
+
+        void sha256(unsigned char* digest, const unsigned char* data, size_t len)
+        {
+            auto state = INITIAL_STATE;
+            hash(state, data, len, len);
+            for(int i = 0; i < 8; i++) {
+                be32enc(digest + i * 4, state[i]);
+            }
+        }
+
+        void double_sha256(
+                unsigned char* digest,
+                const unsigned char* data,
+                size_t len)
+        {
+            auto state = INITIAL_STATE;
+            hash(state, data, len, len);
+            second_pass(digest, state);
+        }
+
+        Sha256Midstate sha256_midstate(const unsigned char* block)
+        {
+            auto state = INITIAL_STATE;
+            compress(state, block, 1);
+            return state;
+        }
+
+        void double_sha256(
+                unsigned char* digest,
+                const Sha256Midstate& midstate,
+                const unsigned char* tail,
+                size_t len)
+        {
+            assert(len < 56);
+            auto state = midstate;
+            compress_last(state, tail, len, 64 + len);
+            second_pass(digest, state);
+        }
+
+        void double_sha256_batch(
+                unsigned char* digests,
+                const unsigned char* data,
+                size_t len,
+                size_t stride,
+                size_t n)
+        {
+            size_t i = 0;
+            if(compress_x8 && len + 9 <= 64 * 4) {
+                for(; i < n; i += 8) {
+                    const size_t lanes = std::min<size_t>(8, n - i);
+                    std::array<State, 8> states;
+                    states.fill(INITIAL_STATE);
+                    hash_x8(states.data(), data + i * stride, len, stride, lanes, len);
+                    second_pass_x8(digests + i * 32, states.data(), lanes);
+                }
+                return;
+            }
+            for(; i < n; i++) {
+                double_sha256(digests + i * 32, data + i * stride, len);
+            }
+        }
+
+        void double_sha256_batch(
+                unsigned char* digests,
+                const Sha256Midstate& midstate,
+                const unsigned char* tails,
+                size_t len,
+                size_t stride,
+                size_t n)
+        {
+            assert(len < 56);
+            size_t i = 0;
+            if(compress_x8) {
+                for(; i < n; i += 8) {
+                    const size_t lanes = std::min<size_t>(8, n - i);
+                    std::array<State, 8> states;
+                    states.fill(midstate);
+                    hash_x8(states.data(), tails + i * stride, len, stride, lanes, 64 + len);
+                    second_pass_x8(digests + i * 32, states.data(), lanes);
+                }
+                return;
+            }
+            for(; i < n; i++) {
+                double_sha256(digests + i * 32, midstate, tails + i * stride, len);
+            }
+        }
+    }
+}
@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2018-2021 The Merit Foundation
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either vedit_refsion 3 of the License, or
+ * (at your option) any later vedit_refsion.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * Botan library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU General Public License in all respects for
+ * all of the code used other than Botan. If you modify file(s) with
+ * this exception, you may extend this exception to your version of the
+ * file(s), but you are not obligated to do so. If you do not wish to do
+ * so, delete this exception statement from your version. If you delete
+ * this exception statement from all source files in the program, then
+ * also delete it here.
+ */
+#include "merit/util/topology.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+namespace merit
+{
+    namespace util
+    {
+        namespace
+        {
+            const std::string NODE_PATH = "/sys/devices/system/node/";
+            const std::string CPU_PATH = "/sys/devices/system/cpu/";
+
+            bool read_line(const std::string& path, std::string& line)
+            {
+                std::ifstream f{path};
+                return f && std::getline(f, line);
+            }
+
+            CpuSet all_cpus()
+            {
+                CpuSet cpus(std::max(1u, std::thread::hardware_concurrency()));
+                for(size_t i = 0; i < cpus.size(); i++) {
+                    cpus[i] = i;
+                }
+                return cpus;
+            }
+
+            // cpus sharing the highest level data or unified cache of cpu
+            std::string last_level_cache(int cpu)
+            {
+                const std::string cache = CPU_PATH + "cpu" + std::to_string(cpu) + "/cache/index";
+                std::string shared;
+                int best = -1;
+                for(int index = 0; ; index++) {
+                    std::string level, type, list;
+                    if(!read_line(cache + std::to_string(index) + "/level", level)) {
+                        break;
+                    }
+                    if(read_line(cache + std::to_string(index) + "/type", type) && type == "Instruction") {
+                        continue;
+                    }
+                    if(!read_line(cache + std::to_string(index) + "/shared_cpu_list", list)) {
+                        continue;
+                    }
+                    try {
+                        if(std::stoi(level) > best) {
+                            best = std::stoi(level);
+                            shared = list;
+                        }
+                    } catch(std::exception&) {
+                    }
+                }
+                return shared;
+            }
+        }
+
+        const char* to_string(Smt smt)
+        {
+            switch(smt) {
+                case Smt::Pair: return "pair";
+                case Smt::Exclude: return "exclude";
+            }
+            return "unknown";
+        }
+
+        CpuSet parse_cpu_list(const std::string& list)
+        {
+            CpuSet cpus;
+            std::stringstream s{list};
+            std::string range;
+            while(std::getline(s, range, ',')) {
+                if(range.empty() || range == "\n") {
+                    continue;
+                }
+
+                auto dash = range.find('-');
+                try {
+                    if(dash == std::string::npos) {
+                        cpus.push_back(std::stoi(range));
+                    } else {
+                        const int first = std::stoi(range.substr(0, dash));
+                        const int last = std::stoi(range.substr(dash + 1));
+                        for(int c = first; c <= last; c++) {
+                            cpus.push_back(c);
+                        }
+                    }
+                } catch(std::exception&) {
+                    return CpuSet{};
+                }
+            }
+            return cpus;
+        }
+
+        std::string to_cpu_list(const CpuSet& cpus)
+        {
+            CpuSet sorted = cpus;
+            std::sort(sorted.begin(), sorted.end());
+            sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+            std::stringstream s;
+            for(size_t i = 0; i < sorted.size();) {
+                size_t j = i;
+                while(j + 1 < sorted.size() && sorted[j + 1] == sorted[j] + 1) {
+                    j++;
+                }
+                if(i > 0) {
+                    s << ',';
+                }
+                s << sorted[i];
+                if(j > i) {
+                    s << '-' << sorted[j];
+                }
+                i = j + 1;
+            }
+            return s.str();
+        }
+
+        NumaNodes numa_nodes()
+        {
+            NumaNodes nodes;
+#ifdef __linux__
+            if(auto dir = opendir(NODE_PATH.c_str())) {
+                while(auto entry = readdir(dir)) {
+                    const std::string name = entry->d_name;
+                    if(name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+                            !std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+                        continue;
+                    }
+
+                    std::string list;
+                    if(!read_line(NODE_PATH + name + "/cpulist", list)) {
+                        continue;
+                    }
+
+                    NumaNode node{std::stoi(name.substr(4)), parse_cpu_list(list)};
+                    // memory only nodes can not run workers
+                    if(!node.cpus.empty()) {
+                        nodes.push_back(node);
+                    }
+                }
+                closedir(dir);
+            }
+#endif
+            if(nodes.empty()) {
+                nodes.push_back(NumaNode{0, all_cpus()});
+            }
+
+            std::sort(nodes.begin(), nodes.end(),
+                    [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+            return nodes;
+        }
+
+        CacheDomains cache_domains()
+        {
+            CacheDomains domains;
+#ifdef __linux__
+            std::string online;
+            const CpuSet cpus = read_line(CPU_PATH + "online", online) ? parse_cpu_list(online) : CpuSet{};
+
+            std::map<int, int> node_of;
+            for(const auto& n : numa_nodes()) {
+                for(auto c : n.cpus) {
+                    node_of[c] = n.id;
+                }
+            }
+
+            // domains and cores keyed by their cpu lists, in cpu order
+            std::map<std::string, size_t> domain_index;
+            std::map<std::string, std::pair<size_t, size_t>> core_index;
+            for(auto cpu : cpus) {
+                const std::string cache = last_level_cache(cpu);
+                std::string siblings;
+                if(cache.empty() || !read_line(CPU_PATH + "cpu" + std::to_string(cpu) + "/topology/thread_siblings_list", siblings)) {
+                    domains.clear();
+                    break;
+                }
+
+                auto d = domain_index.find(cache);
+                if(d == domain_index.end()) {
+                    d = domain_index.emplace(cache, domains.size()).first;
+                    domains.push_back(CacheDomain{node_of.count(cpu) ? node_of[cpu] : 0, {}});
+                }
+
+                auto& domain = domains[d->second];
+                auto c = core_index.find(siblings);
+                if(c == core_index.end() || c->second.first != d->second) {
+                    core_index[siblings] = {d->second, domain.cores.size()};
+                    domain.cores.push_back(CpuSet{cpu});
+                } else {
+                    domain.cores[c->second.second].push_back(cpu);
+                }
+            }
+#endif
+            if(domains.empty()) {
+                CacheDomain domain{0, {}};
+                for(auto c : all_cpus()) {
+                    domain.cores.push_back(CpuSet{c});
+                }
+                domains.push_back(domain);
+            }
+            return domains;
+        }
+
+        std::vector<CpuSet> assign_cpus(
+                const CacheDomains& domains,
+                int workers,
+                int threads,
+                Smt smt)
+        {
+            // the cpus each domain can hand out, siblings of a core adjacent
+            std::vector<CpuSet> all;
+            for(const auto& d : domains) {
+                CpuSet cpus;
+                for(const auto& core : d.cores) {
+                    if(smt == Smt::Exclude) {
+                        cpus.push_back(core.front());
+                    } else {
+                        cpus.insert(cpus.end(), core.begin(), core.end());
+                    }
+                }
+                all.push_back(cpus);
+            }
+
+            std::vector<CpuSet> free = all;
+            std::vector<CpuSet> sets(std::max(0, workers));
+            for(auto& set : sets) {
+                // the first domain with room for the whole team, else the
+                // one with the most left and spill into the next ones
+                size_t first = free.size();
+                for(size_t d = 0; d < free.size(); d++) {
+                    if(free[d].size() >= static_cast<size_t>(threads)) {
+                        first = d;
+                        break;
+                    }
+                }
+                if(first == free.size()) {
+                    first = std::max_element(free.begin(), free.end(),
+                            [](const CpuSet& a, const CpuSet& b) { return a.size() < b.size(); }) - free.begin();
+                }
+
+                for(size_t d = first; set.size() < static_cast<size_t>(threads);) {
+                    if(std::all_of(free.begin(), free.end(), [](const CpuSet& f) { return f.empty(); })) {
+                        // more threads than cpus, start sharing them
+                        free = all;
+                    }
+                    auto& f = free[d];
+                    const size_t take = std::min(f.size(), threads - set.size());
+                    set.insert(set.end(), f.begin(), f.begin() + take);
+                    f.erase(f.begin(), f.begin() + take);
+                    d = (d + 1) % free.size();
+                }
+            }
+            return sets;
+        }
+
+        bool pin_thread(const CpuSet& cpus)
+        {
+#ifdef __linux__
+            thread_local CpuSet pinned;
+            if(cpus.empty()) {
+                return false;
+            }
+            if(cpus == pinned) {
+                return true;
+            }
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for(auto c : cpus) {
+                if(c >= 0 && c < CPU_SETSIZE) {
+                    CPU_SET(c, &set);
+                }
+            }
+
+            if(sched_setaffinity(0, sizeof(set), &set) != 0) {
+                return false;
+            }
+
+            pinned = cpus;
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        ScopedPin::ScopedPin(const CpuSet& cpus)
+        {
+#ifdef __linux__
+            if(cpus.empty()) {
+                return;
+            }
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if(sched_getaffinity(0, sizeof(set), &set) != 0) {
+                return;
+            }
+            for(int c = 0; c < CPU_SETSIZE; c++) {
+                if(CPU_ISSET(c, &set)) {
+                    _previous.push_back(c);
+                }
+            }
+
+            _restore = _previous != cpus && pin_thread(cpus);
+            _pinned = _previous == cpus || _restore;
+#endif
+        }
+
+        ScopedPin::~ScopedPin()
+        {
+            if(_restore) {
+                pin_thread(_previous);
+            }
+        }
+
+        bool ScopedPin::pinned() const
+        {
+            return _pinned;
+        }
+    }
+}
@@ -29,24 +29,21 @@
  * also delete it here.
  */
 #include "merit/util/util.hpp"
+#include "merit/util/work.hpp"
 
-#include <array>
-#include "merit/PicoSHA2/picosha2.h"
 #include <array>
 
 namespace merit
 {
     namespace util
     {
-        void double_sha256(
-                unsigned char* digest,
-                const unsigned char* data,
-                size_t len)
+        void update_midstate(Work& work)
         {
-			
-            std::array<unsigned char, picosha2::k_digest_size> d;
-            picosha2::hash256(data, data+len, d.begin(), d.end());
-            picosha2::hash256(d.begin(), d.end(), digest, digest+picosha2::k_digest_size);
+            std::array<uint32_t, 16> head;
+            for(int i = 0; i < 16; i++) {
+                be32enc(&head[i], work.data[i]);
+            }
+            work.midstate = sha256_midstate(reinterpret_cast<const unsigned char*>(head.data()));
         }
     }
 }